@@ -40,7 +40,10 @@ static PgCmd commands[] = {
     {"pg_disconnect", "::pg::disconnect", Pg_disconnect,2},
     {"pg_exec", "::pg::sqlexec", Pg_exec,2},
     {"pg_exec_prepared", "::pg::exec_prepared", Pg_exec_prepared,3},
+    {"pg_exec_prepared_many", "::pg::exec_prepared_many", Pg_exec_prepared_many,3},
+    {"pg_autoprepare", "::pg::autoprepare", Pg_autoprepare,3},
     {"pg_select", "::pg::select", Pg_select,2},
+    {"pg_cursor", "::pg::cursor", Pg_cursor,2},
     {"pg_result", "::pg::result", Pg_result,2},
     {"pg_execute", "::pg::execute", Pg_execute,2},
     {"pg_lo_open", "::pg::lo_open", Pg_lo_open,2},
@@ -58,7 +61,9 @@ static PgCmd commands[] = {
     {"pg_sendquery", "::pg::sendquery", Pg_sendquery,2},
     {"pg_sendquery_prepared", "::pg::sendquery_prepared", Pg_sendquery_prepared,3},
     {"pg_getresult", "::pg::getresult", Pg_getresult,2},
+    {"pg_pipeline", "::pg::pipeline", Pg_pipeline,3},
     {"pg_set_single_row_mode", "::pg::set_single_row_mode", Pg_set_single_row_mode,3},
+    {"pg_set_chunked_rows_mode", "::pg::set_chunked_rows_mode", Pg_set_chunked_rows_mode,3},
     {"pg_isbusy", "::pg::isbusy", Pg_isbusy,2},
     {"pg_blocking", "::pg::blocking", Pg_blocking,2},
     {"pg_null_value_string", "::pg::null_value_string", Pg_null_value_string,2},
@@ -72,6 +77,9 @@ static PgCmd commands[] = {
     {"pg_getdata", "::pg::getdata", Pg_getdata,2},
     {"pg_sql", "::pg::sql", Pg_sql,2},
     {"pg_copy_complete", "::pg::copy_complete", Pg_copy_complete, 3},
+    {"pg_copy_in", "::pg::copy_in", Pg_copy_in, 3},
+    {"pg_copy_out", "::pg::copy_out", Pg_copy_out, 3},
+    {"pg_copy_from_channel", "::pg::copy_from_channel", Pg_copy_from_channel, 3},
 #ifdef HAVE_SQLITE3
     {"pg_sqlite", "::pg::sqlite", Pg_sqlite, 3},
 #endif
@@ -134,6 +142,8 @@ Pgtcl_Init(Tcl_Interp *interp)
 	if(pgtclInitEncoding(interp) != TCL_OK)
 		return TCL_ERROR;
 
+	pgtclInitArraySet(interp);
+
 	/* register all pgtcl commands */
 
 	for (cmdPtr = commands; cmdPtr->name != NULL; cmdPtr++) {
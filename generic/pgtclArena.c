@@ -0,0 +1,139 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgtclArena.c
+ *	  per-connection scratch memory for query commands
+ *
+ *	Running a query needs a handful of short-lived buffers: the query
+ *	converted to UTF-8, the parameter value and length arrays, the text
+ *	of a rewritten -variables query and so on.  Rather than ckalloc and
+ *	ckfree each of them, the query commands take them from an arena kept
+ *	with the connection, a single block handed out front to back.
+ *
+ *	A command marks the arena before its first allocation and releases
+ *	the mark when it is done, which gives everything since back at once.
+ *	Marks nest, so a pg_exec run from the body of a pg_select on the same
+ *	connection works above the pg_select's buffers.  Requests that do
+ *	not fit in the block are ckalloc'd and freed on release instead.
+ *
+ *	When the outermost mark is released the block is grown to cover the
+ *	most the arena has had live at once, up to PG_ARENA_MAX, so a steady
+ *	workload soon stops allocating at all.  Every PG_ARENA_DECAY commands
+ *	a block much bigger than recent use is shrunk again.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <string.h>
+
+#include "pgtclArena.h"
+
+struct Pg_ArenaChunk_s
+{
+	Pg_ArenaChunk *next;		/* the allocation before this one */
+	double		align;			/* the memory follows, suitably aligned */
+};
+
+#define PG_ARENA_ALIGN(n)	(((n) + 7) & ~(size_t)7)
+#define PG_CHUNK_HEADER		offsetof(Pg_ArenaChunk, align)
+
+/*
+ * Return size bytes from the arena, valid until the enclosing mark is
+ * released.
+ */
+char *
+PgArenaAlloc(Pg_Arena *arena, size_t size)
+{
+	Pg_ArenaChunk *chunk;
+
+	size = PG_ARENA_ALIGN(size ? size : 1);
+	arena->live += size;
+	if (arena->live > arena->peak)
+		arena->peak = arena->live;
+
+	if (arena->base != NULL && arena->size - arena->used >= size)
+	{
+		char	   *ptr = arena->base + arena->used;
+
+		arena->used += size;
+		return ptr;
+	}
+
+	chunk = (Pg_ArenaChunk *)ckalloc(PG_CHUNK_HEADER + size);
+	chunk->next = arena->overflow;
+	arena->overflow = chunk;
+	return (char *)chunk + PG_CHUNK_HEADER;
+}
+
+void
+PgArenaMark(Pg_Arena *arena, Pg_ArenaMark *mark)
+{
+	mark->used = arena->used;
+	mark->live = arena->live;
+	mark->overflow = arena->overflow;
+	arena->depth++;
+}
+
+/*
+ * Size the block for the next command: big enough for the high-water
+ * mark, rounded up to a power of two.
+ */
+static void
+PgArenaResize(Pg_Arena *arena)
+{
+	size_t		want = PG_ARENA_MIN;
+
+	while (want < arena->peak && want < PG_ARENA_MAX)
+		want <<= 1;
+
+	if (arena->base != NULL)
+		ckfree(arena->base);
+	arena->base = ckalloc(want);
+	arena->size = want;
+}
+
+/*
+ * Give back everything allocated since the mark.  Marks must be released
+ * in the reverse of the order they were taken.
+ */
+void
+PgArenaRelease(Pg_Arena *arena, Pg_ArenaMark *mark)
+{
+	while (arena->overflow != mark->overflow)
+	{
+		Pg_ArenaChunk *chunk = arena->overflow;
+
+		arena->overflow = chunk->next;
+		ckfree((char *)chunk);
+	}
+	arena->used = mark->used;
+	arena->live = mark->live;
+
+	if (--arena->depth > 0)
+		return;
+
+	if (arena->peak > arena->size && arena->size < PG_ARENA_MAX)
+		PgArenaResize(arena);
+	else if (++arena->commands >= PG_ARENA_DECAY)
+	{
+		if (arena->peak * 4 < arena->size && arena->size > PG_ARENA_MIN)
+			PgArenaResize(arena);
+		arena->commands = 0;
+		arena->peak = 0;
+	}
+}
+
+/* Free the arena's memory when its connection goes away */
+void
+PgArenaFree(Pg_Arena *arena)
+{
+	while (arena->overflow != NULL)
+	{
+		Pg_ArenaChunk *chunk = arena->overflow;
+
+		arena->overflow = chunk->next;
+		ckfree((char *)chunk);
+	}
+	if (arena->base != NULL)
+		ckfree(arena->base);
+	memset(arena, 0, sizeof(Pg_Arena));
+}
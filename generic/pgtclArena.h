@@ -0,0 +1,57 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgtclArena.h
+ *	  per-connection scratch memory for query commands
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PGTCLARENA_H
+#define PGTCLARENA_H
+
+#include <stddef.h>
+#include <tcl.h>
+
+#define PG_ARENA_MIN	1024			/* smallest block worth keeping */
+#define PG_ARENA_MAX	(1024 * 1024)	/* largest; bigger requests overflow */
+#define PG_ARENA_DECAY	1000			/* commands between shrink checks */
+
+/* Allocations that did not fit in the block, freed on release */
+typedef struct Pg_ArenaChunk_s Pg_ArenaChunk;
+
+typedef struct Pg_Arena_s
+{
+	char	   *base;			/* the block, or NULL */
+	size_t		size;			/* bytes in the block */
+	size_t		used;			/* bytes of the block handed out */
+	size_t		live;			/* bytes handed out, block and overflow */
+	size_t		peak;			/* high-water mark of live */
+	int			depth;			/* marks not yet released */
+	int			commands;		/* outermost releases since the last shrink check */
+	Pg_ArenaChunk *overflow;	/* newest overflow allocation */
+}	Pg_Arena;
+
+/* Where the arena stood when a command started */
+typedef struct Pg_ArenaMark
+{
+	size_t		used;
+	size_t		live;
+	Pg_ArenaChunk *overflow;
+}	Pg_ArenaMark;
+
+extern char *PgArenaAlloc(Pg_Arena *arena, size_t size);
+extern void PgArenaMark(Pg_Arena *arena, Pg_ArenaMark *mark);
+extern void PgArenaRelease(Pg_Arena *arena, Pg_ArenaMark *mark);
+extern void PgArenaFree(Pg_Arena *arena);
+
+/*
+ * Helpers that take an optional arena allocate from it when given one,
+ * leaving the memory to be reclaimed by PgArenaRelease, and with ckalloc
+ * otherwise.
+ */
+#define PgScratchAlloc(arena, size) \
+	((arena) ? PgArenaAlloc((arena), (size)) : ckalloc(size))
+#define PgScratchFree(arena, ptr) \
+	do { if ((ptr) && !(arena)) ckfree((char *)(ptr)); } while (0)
+
+#endif
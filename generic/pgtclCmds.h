@@ -18,6 +18,25 @@
 #include "libpq-fe.h"
 
 extern int pgtclInitEncoding(Tcl_Interp *interp);
+extern void pgtclInitArraySet(Tcl_Interp *interp);
+
+/* conversion between Tcl's internal UTF and the external UTF-8 libpq uses */
+extern char *makeExternalString(Tcl_Interp *interp, const char *utfString, int length);
+extern const char *getExternalString(Tcl_Interp *interp, const char *utfString, int length, char **bufferPtr);
+extern char *makeUTFString(Tcl_Interp *interp, const char *externalString, int length);
+extern Tcl_Obj *makeUTFStringObj(Tcl_Interp *interp, const char *externalString, int length);
+
+/*
+ * Result statuses that carry rows.  PGRES_TUPLES_CHUNK comes with
+ * PQsetChunkedRowsMode, new in libpq 17.
+ */
+#ifdef HAVE_PQSETCHUNKEDROWSMODE
+#define PG_ROWS_STATUS(status) ((status) == PGRES_TUPLES_OK || (status) == PGRES_SINGLE_TUPLE || (status) == PGRES_TUPLES_CHUNK)
+#else
+#define PG_ROWS_STATUS(status) ((status) == PGRES_TUPLES_OK || (status) == PGRES_SINGLE_TUPLE)
+#endif
+
+extern int PgSetRowMode(PGconn *conn, int chunkSize);
 
 /* MOVED structure definitions for connection IDs to pctclId.h */
 
@@ -39,12 +58,21 @@ extern int Pg_exec(
 extern int Pg_exec_prepared(
   ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
 
+extern int Pg_exec_prepared_many(
+  ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
+
+extern int Pg_autoprepare(
+  ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
+
 extern int Pg_execute(
   ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
 
 extern int Pg_select(
   ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
 
+extern int Pg_cursor(
+  ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
+
 extern int Pg_result(
   ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
 
@@ -93,9 +121,24 @@ extern int Pg_sendquery_prepared(
 extern int Pg_getresult(
   ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
 
+extern int Pg_pipeline(
+  ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
+
+extern int Pg_copy_in(
+  ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
+
+extern int Pg_copy_out(
+  ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
+
+extern int Pg_copy_from_channel(
+  ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
+
 extern int Pg_set_single_row_mode(
   ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
 
+extern int Pg_set_chunked_rows_mode(
+  ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
+
 extern int Pg_isbusy(
   ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
 
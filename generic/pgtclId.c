@@ -21,9 +21,11 @@
 #include <errno.h>
 #include <string.h>
 #include <libpq-fe.h>
+#include <libpq-events.h>
 
 #include "pgtclCmds.h"
 #include "pgtclId.h"
+#include "pgtclPrepare.h"
 #ifdef HAVE_SQLITE3
 #  include "pgtclSqlite.h"
 #endif
@@ -31,25 +33,45 @@
 static int
 PgEndCopy(Pg_ConnectionId * connid, int *errorCodePtr, int writing)
 {
+	ExecStatusType status = PGRES_COMMAND_OK;
+	int            returnCode = 0;
+
 	connid->res_copyStatus = RES_COPY_NONE;
+	if (connid->copyInNull)
+	{
+		Tcl_DecrRefCount(connid->copyInNull);
+		connid->copyInNull = NULL;
+	}
+	if (connid->copyOutRow)
+	{
+		PQfreemem(connid->copyOutRow);
+		connid->copyOutRow = NULL;
+	}
+	connid->copyOutEnd = 0;
 	if (writing && PQputCopyEnd(connid->conn, NULL) != 1)
 	{
-		PQclear(connid->results[connid->res_copy]);
-		connid->results[connid->res_copy] =
-			PQmakeEmptyPGresult(connid->conn, PGRES_BAD_RESPONSE);
-		connid->res_copy = -1;
+		status = PGRES_BAD_RESPONSE;
 		*errorCodePtr = EIO;
 		PgCheckConnectionState(connid);
-		return -1;
+		returnCode = -1;
 	}
-	else
+
+	/*
+	 * A nonblocking connection may still have COPY data queued in libpq.
+	 * It isn't waited for here: it goes out as the channel's writable
+	 * handler flushes, and PQconsumeInput and PQgetResult flush it before
+	 * anyone can see the COPY's result.
+	 */
+
+	/* a COPY opened by pg_copy_in has no result handle */
+	if (connid->res_copy >= 0)
 	{
 		PQclear(connid->results[connid->res_copy]);
 		connid->results[connid->res_copy] =
-			PQmakeEmptyPGresult(connid->conn, PGRES_COMMAND_OK);
+			PQmakeEmptyPGresult(connid->conn, status);
 		connid->res_copy = -1;
-		return 0;
 	}
+	return returnCode;
 }
 
 /*
@@ -61,7 +83,6 @@ PgInputProc(DRIVER_INPUT_PROTO)
 	Pg_ConnectionId *connid;
 	PGconn	   *conn;
 	int			avail;
-	char	*bufPtr = NULL;
 
 	connid = (Pg_ConnectionId *) cData;
 	conn = connid->conn;
@@ -75,40 +96,66 @@ PgInputProc(DRIVER_INPUT_PROTO)
 	}
 
 	/*
-	 * Read any newly arrived data into libpq's buffer, thereby clearing
-	 * the socket's read-ready condition.
+	 * Each PQgetCopyData hands back a whole row.  When the row is longer
+	 * than Tcl's buffer, hold on to it and pass on the rest next time.
+	 * If the channel is nonblocking, so is libpq, and a row that hasn't
+	 * all arrived yet is EAGAIN.
 	 */
-	if (!PQconsumeInput(conn))
+	if (connid->copyOutRow == NULL)
 	{
-		*errorCodePtr = EIO;
-		PgCheckConnectionState(connid);
-		return -1;
-	}
+		if (connid->copyOutEnd)
+		{
+			/* PgCopyOutReady already saw the end */
+			avail = connid->copyOutEnd;
+			connid->copyOutEnd = 0;
+		}
+		else if (PQisnonblocking(conn))
+		{
+			if (!PQconsumeInput(conn))
+				avail = -2;
+			else
+				avail = PQgetCopyData(conn, &connid->copyOutRow, 1);
+		}
+		else
+		{
+			avail = PQgetCopyData(conn, &connid->copyOutRow, 0);
+		}
 
-	/* Move data from libpq's buffer to Tcl's. */
+		switch (avail) {
+		  case -2: {
+			*errorCodePtr = EIO;
+			PgCheckConnectionState(connid);
+			return -1;
+		  }
+		  case -1: {
+			// PgEndCopy calls PgCheckConnectionState if needed.
+			return PgEndCopy(connid, errorCodePtr, 0);
+		  }
+		  case 0: {
+			*errorCodePtr = EAGAIN;
+			return -1;
+		  }
+		}
 
-	switch(avail = PQgetCopyData(conn, &bufPtr, bufSize)) {
-	  case -2: {
-		*errorCodePtr = EIO;
-		PgCheckConnectionState(connid);
-		return -1;
-	  }
-	  case -1: {
-		// PgEndCopy calls PgCheckConnectionState if needed.
-		return PgEndCopy(connid, errorCodePtr, 0);
-	  }
+		/* Should never happen */
+		if (avail < 0 || connid->copyOutRow == NULL) {
+			*errorCodePtr = EIO;
+			PgCheckConnectionState(connid);
+			return -1;
+		}
+		connid->copyOutPos = 0;
+		connid->copyOutLen = avail;
 	}
 
-	/* Should never happen */
-	if(avail < 0) {
-		*errorCodePtr = EIO;
-		PgCheckConnectionState(connid);
-		return -1;
-	}
+	avail = connid->copyOutLen - connid->copyOutPos;
+	if (avail > bufSize)
+		avail = bufSize;
+	memcpy (buf, connid->copyOutRow + connid->copyOutPos, avail);
+	connid->copyOutPos += avail;
 
-	if(bufPtr) {
-		memcpy (buf, bufPtr, avail);
-		PQfreemem(bufPtr);
+	if (connid->copyOutPos == connid->copyOutLen) {
+		PQfreemem(connid->copyOutRow);
+		connid->copyOutRow = NULL;
 	}
 
 	return avail;
@@ -136,6 +183,17 @@ PgOutputProc(DRIVER_OUTPUT_PROTO)
 		return -1;
 	}
 
+	/*
+	 * On a nonblocking connection, take no more until libpq has sent what
+	 * it already has, so that it doesn't buffer without limit.
+	 */
+	if (PQisnonblocking(conn) && PQflush(conn) != 0)
+	{
+		*errorCodePtr = PQstatus(conn) == CONNECTION_BAD ? EIO : EAGAIN;
+		PgCheckConnectionState(connid);
+		return -1;
+	}
+
 	writeLen = bufSize;
 
 	/*
@@ -164,23 +222,169 @@ PgOutputProc(DRIVER_OUTPUT_PROTO)
 }
 
 /*
- * The WatchProc and GetHandleProc are no-ops but must be present.
+ * Channel events
+ *
+ * fileevent and fcopy on the connection are driven by the libpq socket,
+ * watched through the notifier channel.  The socket alone isn't enough:
+ * libpq may already have read rows that nobody has asked for yet, by
+ * the notifier or by an earlier read, and then the socket won't become
+ * readable again for them.  So a COPY OUT row that can be had from libpq
+ * without waiting makes the channel readable, and is reported from a zero
+ * timer.  The channel is writable when libpq has nothing left to send.
+ */
+
+static void PgWatchTimerProc(ClientData clientData);
+
+/*
+ * Is there COPY OUT data to read without waiting?  A row is pulled from
+ * libpq into copyOutRow to find out, and the end of the COPY is noted in
+ * copyOutEnd for PgInputProc, as libpq only reports it once.
+ */
+static int
+PgCopyOutReady(Pg_ConnectionId * connid)
+{
+	int			length;
+
+	if (connid->copyOutRow != NULL || connid->copyOutEnd != 0)
+		return 1;
+
+	if (connid->res_copy < 0 ||
+		PQresultStatus(connid->results[connid->res_copy]) != PGRES_COPY_OUT)
+		return 0;
+
+	length = PQgetCopyData(connid->conn, &connid->copyOutRow, 1);
+	if (length == 0)
+		return 0;
+
+	if (length > 0)
+	{
+		connid->copyOutPos = 0;
+		connid->copyOutLen = length;
+	}
+	else
+		connid->copyOutEnd = length;
+	return 1;
+}
+
+/* Which of the events in mask the connection is ready for now */
+static int
+PgChannelReady(Pg_ConnectionId * connid, int mask)
+{
+	int			ready = 0;
+
+	if (connid->conn == NULL)
+		return 0;
+
+	if ((mask & TCL_READABLE) && PgCopyOutReady(connid))
+		ready |= TCL_READABLE;
+
+	if ((mask & TCL_WRITABLE) && PQflush(connid->conn) == 0)
+		ready |= TCL_WRITABLE;
+
+	return ready;
+}
+
+/* Tell the channel's handlers about whatever they're waiting for that's ready */
+static void
+PgWatchNotify(Pg_ConnectionId * connid, int ready)
+{
+	ready |= PgChannelReady(connid, connid->watchMask & ~ready);
+	ready &= connid->watchMask;
+
+	if (ready)
+		Tcl_NotifyChannel(connid->conn_channel, ready);
+}
+
+static void
+PgWatchTimerProc(ClientData clientData)
+{
+	Pg_ConnectionId *connid = (Pg_ConnectionId *) clientData;
+
+	connid->watchTimer = NULL;
+	PgWatchNotify(connid, 0);
+}
+
+/* Channel handler on the notifier channel, called when the socket is ready */
+static void
+PgWatchSocketProc(ClientData clientData, int mask)
+{
+	Pg_ConnectionId *connid = (Pg_ConnectionId *) clientData;
+
+	/*
+	 * Take in what the socket has, so it stops being readable.  If that
+	 * fails, let the channel's reader find the error; stop watching the
+	 * socket so a dead one doesn't keep firing.
+	 */
+	if ((mask & TCL_READABLE) && !PQconsumeInput(connid->conn))
+	{
+		Tcl_DeleteChannelHandler(connid->notifier_channel,
+								 PgWatchSocketProc, (ClientData) connid);
+		PgWatchNotify(connid, TCL_READABLE);
+		return;
+	}
+
+	PgWatchNotify(connid, 0);
+}
+
+/*
+ * Called by Tcl with the events the channel's handlers want to hear about.
  */
 static void
 PgWatchProc(ClientData instanceData, int mask)
 {
+	Pg_ConnectionId *connid = (Pg_ConnectionId *) instanceData;
+
+	connid->watchMask = mask;
+
+	if (mask && connid->conn != NULL && PQstatus(connid->conn) != CONNECTION_BAD)
+		Tcl_CreateChannelHandler(connid->notifier_channel, mask,
+								 PgWatchSocketProc, (ClientData) connid);
+	else
+		Tcl_DeleteChannelHandler(connid->notifier_channel,
+								 PgWatchSocketProc, (ClientData) connid);
+
+	if (mask && connid->watchTimer == NULL && PgChannelReady(connid, mask))
+		connid->watchTimer = Tcl_CreateTimerHandler(0, PgWatchTimerProc, (ClientData) connid);
+	else if (!mask && connid->watchTimer != NULL)
+	{
+		Tcl_DeleteTimerHandler(connid->watchTimer);
+		connid->watchTimer = NULL;
+	}
 }
 
+/* The channel's handle is the libpq socket */
 static int
 PgGetHandleProc(ClientData instanceData, int direction,
 				ClientData *handlePtr)
 {
-	return TCL_ERROR;
+	Pg_ConnectionId *connid = (Pg_ConnectionId *) instanceData;
+
+	if (connid->conn == NULL || PQsocket(connid->conn) < 0)
+		return TCL_ERROR;
+
+	*handlePtr = (ClientData)(long)PQsocket(connid->conn);
+	return TCL_OK;
+}
+
+/*
+ * fconfigure -blocking sets libpq's blocking mode to match, as pg_blocking
+ * does.
+ */
+static int
+PgBlockModeProc(ClientData instanceData, int mode)
+{
+	Pg_ConnectionId *connid = (Pg_ConnectionId *) instanceData;
+
+	if (connid->conn == NULL ||
+		PQsetnonblocking(connid->conn, mode == TCL_MODE_NONBLOCKING) != 0)
+		return EIO;
+
+	return 0;
 }
 
 Tcl_ChannelType Pg_ConnType = {
     "pgsql",             /* channel type */
-    NULL,                /* blockmodeproc */
+    TCL_CHANNEL_VERSION_2, /* version */
     PgDelConnectionId,   /* closeproc */
     PgInputProc,         /* inputproc */
     PgOutputProc,        /* outputproc */
@@ -190,7 +394,7 @@ Tcl_ChannelType Pg_ConnType = {
     PgWatchProc,         /* WatchProc, must be defined */
     PgGetHandleProc,     /* GetHandleProc, must be defined */
     NULL,                /* Close2Proc, Not used */
-    NULL,                /* blockModeProc, Not used */
+    PgBlockModeProc,     /* blockModeProc */
     NULL,                /* flushProc */
     NULL,                /* handlerProc */
     NULL,                /* wideSeekProc */
@@ -198,6 +402,144 @@ Tcl_ChannelType Pg_ConnType = {
     NULL                 /* truncateProc */
 };
 
+/*
+ * A connection handle object caches the connection it names, so the pg_*
+ * commands don't have to look the handle up as a channel each time.  The
+ * objects point at a small Pg_ConnHandle shared with the connection, not
+ * at the Pg_ConnectionId, which is freed when the channel is closed; at
+ * that point PgDelConnectionId clears the Pg_ConnHandle's connid so the
+ * objects know their cache is stale.  While a command holds the channel
+ * open the connid outlives the handle, so PgGetConnectionIdFromObj checks
+ * the channel is still registered.
+ */
+struct Pg_ConnHandle_s
+{
+	int			refCount;		/* the connection and objects caching it */
+	Pg_ConnectionId *connid;	/* NULL once the connection is closed */
+};
+
+static void FreeConnHandleInternalRep(Tcl_Obj *objPtr);
+static void DupConnHandleInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *dupPtr);
+
+static const Tcl_ObjType connHandleType = {
+	"pgtclConnectionHandle",
+	FreeConnHandleInternalRep,
+	DupConnHandleInternalRep,
+	NULL,
+	NULL
+};
+
+static void
+PgReleaseConnHandle(Pg_ConnHandle *handle)
+{
+	if (--handle->refCount > 0)
+		return;
+
+	ckfree((void *)handle);
+}
+
+static void
+FreeConnHandleInternalRep(Tcl_Obj *objPtr)
+{
+	PgReleaseConnHandle((Pg_ConnHandle *)objPtr->internalRep.twoPtrValue.ptr1);
+	objPtr->typePtr = NULL;
+}
+
+static void
+DupConnHandleInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *dupPtr)
+{
+	Pg_ConnHandle *handle = (Pg_ConnHandle *)srcPtr->internalRep.twoPtrValue.ptr1;
+
+	handle->refCount++;
+	dupPtr->internalRep.twoPtrValue.ptr1 = handle;
+	dupPtr->typePtr = &connHandleType;
+}
+
+/* Make objPtr, whose string is connid's handle, remember the connection */
+static void
+PgCacheConnectionId(Tcl_Obj *objPtr, Pg_ConnectionId *connid)
+{
+	Pg_ConnHandle *handle = connid->handle;
+
+	/* the string is all that will be left of the old internal rep */
+	Tcl_GetString(objPtr);
+
+	handle->refCount++;
+	if (objPtr->typePtr && objPtr->typePtr->freeIntRepProc)
+		objPtr->typePtr->freeIntRepProc(objPtr);
+	objPtr->internalRep.twoPtrValue.ptr1 = handle;
+	objPtr->internalRep.twoPtrValue.ptr2 = NULL;
+	objPtr->typePtr = &connHandleType;
+}
+
+/*
+ * A copy of the connection's handle for a command, its connection cached.
+ * PgConnCmd holds a reference until the command returns, since the command
+ * may keep the object (pipeline results -callback) or let it go.
+ */
+static Tcl_Obj *
+PgConnHandleObj(Pg_ConnectionId *connid)
+{
+	Tcl_Obj    *objPtr;
+
+	if (connid->handleObj == NULL)
+		objPtr = Tcl_NewStringObj(connid->id, -1);
+	else
+		objPtr = Tcl_DuplicateObj(connid->handleObj);
+	Tcl_IncrRefCount(objPtr);
+	return objPtr;
+}
+
+/*
+ * PgResultEventProc --
+ *
+ *    libpq event procedure for every connection.  Each new result gets a
+ *    copy of the session's TimeZone at the time, so binary timestamptz
+ *    values can be shown as the server would have shown them as text.
+ */
+static int
+PgResultEventProc(PGEventId evtId, void *evtInfo, void *passThrough)
+{
+	const char *timeZone;
+	PGresult   *result;
+	char       *copy;
+
+	switch (evtId)
+	{
+		case PGEVT_RESULTCREATE:
+			timeZone = PQparameterStatus(((PGEventResultCreate *)evtInfo)->conn, "TimeZone");
+			result = ((PGEventResultCreate *)evtInfo)->result;
+			break;
+
+		case PGEVT_RESULTCOPY:
+			timeZone = PgResultTimeZone(((PGEventResultCopy *)evtInfo)->src);
+			result = ((PGEventResultCopy *)evtInfo)->dest;
+			break;
+
+		default:
+			return 1;
+	}
+
+	if (timeZone != NULL) {
+		/* freed along with the result */
+		copy = PQresultAlloc(result, strlen(timeZone) + 1);
+		if (copy == NULL)
+			return 0;
+		strcpy(copy, timeZone);
+		PQresultSetInstanceData(result, PgResultEventProc, copy);
+	}
+	return 1;
+}
+
+/*
+ * The session's TimeZone when result was made, or NULL if not known.
+ */
+const char *
+PgResultTimeZone(const PGresult *result)
+{
+	return (const char *)PQresultInstanceData(result, PgResultEventProc);
+}
+
 /*
  * Create and register a new channel for the connection
  */
@@ -213,21 +555,39 @@ PgSetConnectionId(Tcl_Interp *interp, PGconn *conn, char *chandle)
 	connid = (Pg_ConnectionId *) ckalloc(sizeof(Pg_ConnectionId));
 	connid->conn = conn;
 	connid->res_count = 0;
-	connid->res_last = -1;
 	connid->res_max = RES_START;
-	connid->res_hardmax = RES_HARD_MAX;
 	connid->res_copy = -1;
 	connid->res_copyStatus = RES_COPY_NONE;
 	connid->results = (PGresult **)ckalloc(sizeof(PGresult *) * RES_START);
 	connid->resultids = (Pg_resultid **)ckalloc(sizeof(Pg_resultid *) * RES_START);
+	connid->res_freeNext = (int *)ckalloc(sizeof(int) * RES_START);
+	connid->res_freeHead = 0;
+	connid->res_freeTail = RES_START - 1;
         connid->callbackPtr = (Tcl_Obj *) NULL;
         connid->callbackInterp = (Tcl_Interp *) NULL;
+	connid->asyncSelect = NULL;
+	connid->cursors = NULL;
+	connid->cursorPrefetch = NULL;
+	connid->cursor_count = 0;
+	connid->pipelineQueued = 0;
+	connid->pipelineSyncs = 0;
+	connid->prepareCache = NULL;
+	memset(&connid->arena, 0, sizeof(connid->arena));
+	connid->copyInNull = NULL;
+	connid->copyOutRow = NULL;
+	connid->copyOutPos = 0;
+	connid->copyOutLen = 0;
+	connid->copyOutEnd = 0;
+	connid->watchMask = 0;
+	connid->watchTimer = NULL;
+	connid->channelHolds = 0;
 
 
 	for (i = 0; i < RES_START; i++)
 	{
 		connid->results[i] = NULL;
 		connid->resultids[i] = NULL;
+		connid->res_freeNext[i] = i + 1 < RES_START ? i + 1 : -1;
 	}
 
 	connid->notify_list = NULL;
@@ -264,6 +624,15 @@ PgSetConnectionId(Tcl_Interp *interp, PGconn *conn, char *chandle)
 	{
 	    return 0;
 	}
+
+	connid->handle = (Pg_ConnHandle *)ckalloc(sizeof(Pg_ConnHandle));
+	connid->handle->refCount = 1;
+	connid->handle->connid = connid;
+	connid->handleObj = Tcl_NewStringObj(connid->id, -1);
+	Tcl_IncrRefCount(connid->handleObj);
+	PgCacheConnectionId(connid->handleObj, connid);
+
+	PQregisterEventProc(conn, PgResultEventProc, "pgtcl", NULL);
 	
 	connid->notifier_channel = Tcl_MakeTcpClientChannel((ClientData)(long)PQsocket(conn));
 	/* Code  executing  outside  of  any Tcl interpreter can call
@@ -280,9 +649,10 @@ PgSetConnectionId(Tcl_Interp *interp, PGconn *conn, char *chandle)
 
 	conn_chan = Tcl_CreateChannel(&Pg_ConnType, connid->id, (ClientData) connid,
 								  TCL_READABLE | TCL_WRITABLE);
+	connid->conn_channel = conn_chan;
 
 	Tcl_SetChannelOption(interp, conn_chan, "-buffering", "line");
-	Tcl_SetResult(interp, connid->id, TCL_VOLATILE);
+	Tcl_SetObjResult(interp, Tcl_DuplicateObj(connid->handleObj));
 	Tcl_RegisterChannel(interp, conn_chan);
 
     connid->cmd_token=Tcl_CreateObjCommand(interp, connid->id, PgConnCmd, (ClientData) connid, PgDelCmdHandle);
@@ -311,7 +681,6 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
     int             idx = 1;
     char            *arg;
     Tcl_Obj         *objvx[25];
-    Tcl_CmdInfo     info;
     Pg_ConnectionId *connid;
     int             returnCode = TCL_ERROR;
 
@@ -323,8 +692,9 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
 	"lo_unlink", "lo_import", "lo_export", "sendquery", "exec_prepared", 
         "sendquery_prepared",  "null_value_string", "version", 
         "protocol", "param", "backendpid", "socket", 
-	"conndefaults",  "set_single_row_mode", "is_busy", "blocking",
-	"cancel_request", "copy_complete",
+	"conndefaults",  "set_single_row_mode", "set_chunked_rows_mode", "is_busy", "blocking",
+	"cancel_request", "copy_complete", "cursor", "pipeline", "exec_prepared_many", "autoprepare",
+	"copy_in", "copy_out", "copy_from_channel",
 #ifdef HAVE_SQLITE3
 	"sqlite",
 #endif
@@ -340,8 +710,9 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
 	LO_IMPORT, LO_EXPORT, SENDQUERY, EXEC_PREPARED, 
 	SENDQUERY_PREPARED, NULL_VALUE_STRING, VERSION, 
 	PROTOCOL, PARAM, BACKENDPID, SOCKET,
-	CONNDEFAULTS, SET_SINGLE_ROW_MODE, ISBUSY, BLOCKING,
-	CANCELREQUEST, COPY_COMPLETE,
+	CONNDEFAULTS, SET_SINGLE_ROW_MODE, SET_CHUNKED_ROWS_MODE, ISBUSY, BLOCKING,
+	CANCELREQUEST, COPY_COMPLETE, CURSOR, PIPELINE, EXEC_PREPARED_MANY, AUTOPREPARE,
+	COPY_IN, COPY_OUT, COPY_FROM_CHANNEL,
 #ifdef HAVE_SQLITE3
 	SQLITE3
 #endif
@@ -365,10 +736,7 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
     objvx[0] = objv[1];
     objvx[1] = objv[0];
 
-    if (Tcl_GetCommandInfo(interp, Tcl_GetString(objvx[1]), &info) == 0)
-        return TCL_ERROR;
-
-    connid = (Pg_ConnectionId *) info.objClientData;
+    connid = (Pg_ConnectionId *) cData;
 
 
     if (Tcl_GetIndexFromObj(interp, objv[1], options, "command", TCL_EXACT, &optIndex) != TCL_OK)
@@ -379,7 +747,7 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
      *  a little differently
     if ((optIndex != EXECUTE) && (optIndex != UNESCAPE_BYTEA))
     {
-        objvx[1] = Tcl_NewStringObj(connid->id, -1);
+        objvx[1] = PgConnHandleObj(connid);
     }
 */
 
@@ -396,7 +764,7 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
 		return TCL_ERROR;
 	    }
 
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_quote(cData, interp, objc, objvx);
             break;
 	}
@@ -412,7 +780,7 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
 		return TCL_ERROR;
 	    }
 
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_escapeBytea(cData, interp, objc, objvx);
             break;
 	}
@@ -431,14 +799,14 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
 
         case DISCONNECT:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_disconnect(cData, interp, objc, objvx);
             break;
         }
         case EXEC:
         case SQLEXEC:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_exec(cData, interp, objc, objvx);
 			break;
         }
@@ -476,115 +844,115 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
             */
 
             idx += num;
-            objvx[idx] = Tcl_NewStringObj(connid->id, -1);
+            objvx[idx] = PgConnHandleObj(connid);
             returnCode = Pg_execute(cData, interp, objc, objvx);
 			break;
         }
         case SELECT:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_select(cData, interp, objc, objvx);
 			break;
         }
         case LISTEN:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_listen(cData, interp, objc, objvx);
 			break;
         }
         case ON_CONNECTION_LOSS:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_listen(cData, interp, objc, objvx);
 			break;
         }
         case LO_CREAT:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_creat(cData, interp, objc, objvx);
 			break;
         }
         case LO_OPEN:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_open(cData, interp, objc, objvx);
 			break;
         }
         case LO_CLOSE:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_close(cData, interp, objc, objvx);
 			break;
         }
         case LO_READ:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_read(cData, interp, objc, objvx);
 			break;
         }
         case LO_WRITE:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_write(cData, interp, objc, objvx);
 			break;
         }
         case LO_LSEEK:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_lseek(cData, interp, objc, objvx);
 			break;
         }
         case LO_TELL:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_tell(cData, interp, objc, objvx);
 			break;
         }
         case LO_TRUNCATE:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_truncate(cData, interp, objc, objvx);
 			break;
         }
         case LO_UNLINK:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_unlink(cData, interp, objc, objvx);
 			break;
         }
         case LO_IMPORT:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_import(cData, interp, objc, objvx);
 			break;
         }
         case LO_EXPORT:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_lo_export(cData, interp, objc, objvx);
 			break;
         }
         case SENDQUERY:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_sendquery(cData, interp, objc, objvx);
 			break;
         }
         case EXEC_PREPARED:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_exec_prepared(cData, interp, objc, objvx);
 			break;
         }
         case SENDQUERY_PREPARED:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_sendquery_prepared(cData, interp, objc, objvx);
 			break;
         }
         case NULL_VALUE_STRING:
         {
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_null_value_string(cData, interp, objc, objvx);
 			break;
         }
@@ -598,7 +966,7 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
             objvx[2] = objv[0];
             objvx[1] = objv[1];
             idx++;
-            objvx[idx] = Tcl_NewStringObj(connid->id, -1);
+            objvx[idx] = PgConnHandleObj(connid);
             returnCode= Pg_dbinfo(cData, interp, objc, objvx);
 	    break;
         }
@@ -610,7 +978,7 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
             objvx[1] = objv[1];
             objvx[3] = objv[2];
             idx++;
-            objvx[idx] = Tcl_NewStringObj(connid->id, -1);
+            objvx[idx] = PgConnHandleObj(connid);
             returnCode= Pg_dbinfo(cData, interp, objc, objvx);
 	    break;
         }
@@ -621,43 +989,118 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
 	
 	case SET_SINGLE_ROW_MODE:
 	{
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_set_single_row_mode(cData, interp, objc, objvx);
 	    break;
 	}
+
+	case SET_CHUNKED_ROWS_MODE:
+	{
+            objvx[1] = PgConnHandleObj(connid);
+            returnCode = Pg_set_chunked_rows_mode(cData, interp, objc, objvx);
+	    break;
+	}
 	
 	case ISBUSY:
 	{
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_isbusy(cData, interp, objc, objvx);
 	    break;
 	}
 	
 	case BLOCKING:
 	{
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_blocking(cData, interp, objc, objvx);
 	    break;
 	}
 
 	case CANCELREQUEST:
 	{
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_cancelrequest(cData, interp, objc, objvx);
 	    break;
 	}
 
 	case COPY_COMPLETE:
 	{
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_copy_complete(cData, interp, objc, objvx);
 	    break;
 	}
 
+	case CURSOR:
+	{
+            objvx[1] = PgConnHandleObj(connid);
+            returnCode = Pg_cursor(cData, interp, objc, objvx);
+	    break;
+	}
+
+	case PIPELINE:
+	{
+	    /* the subcommand goes before the connection */
+	    if (objc < 3)
+	    {
+		Tcl_WrongNumArgs(interp, 1, objv, "pipeline enter|exit|sync|send|results|status ?arg ...?");
+		return TCL_ERROR;
+	    }
+            objvx[1] = objv[2];
+            objvx[2] = PgConnHandleObj(connid);
+            idx = 2;
+            returnCode = Pg_pipeline(cData, interp, objc, objvx);
+	    break;
+	}
+
+	case EXEC_PREPARED_MANY:
+	{
+            objvx[1] = PgConnHandleObj(connid);
+            returnCode = Pg_exec_prepared_many(cData, interp, objc, objvx);
+	    break;
+	}
+
+	case AUTOPREPARE:
+	{
+            objvx[1] = PgConnHandleObj(connid);
+            returnCode = Pg_autoprepare(cData, interp, objc, objvx);
+	    break;
+	}
+
+	case COPY_IN:
+	{
+	    /* append and finish go before the connection, as for pipeline */
+	    if (objc > 2 && (strcmp(Tcl_GetString(objv[2]), "append") == 0
+			     || strcmp(Tcl_GetString(objv[2]), "finish") == 0))
+	    {
+		objvx[1] = objv[2];
+		objvx[2] = PgConnHandleObj(connid);
+		idx = 2;
+	    }
+	    else
+	    {
+		objvx[1] = PgConnHandleObj(connid);
+	    }
+            returnCode = Pg_copy_in(cData, interp, objc, objvx);
+	    break;
+	}
+
+	case COPY_OUT:
+	{
+            objvx[1] = PgConnHandleObj(connid);
+            returnCode = Pg_copy_out(cData, interp, objc, objvx);
+	    break;
+	}
+
+	case COPY_FROM_CHANNEL:
+	{
+            objvx[1] = PgConnHandleObj(connid);
+            returnCode = Pg_copy_from_channel(cData, interp, objc, objvx);
+	    break;
+	}
+
 #ifdef HAVE_SQLITE3
 	case SQLITE3:
 	{
-            objvx[1] = Tcl_NewStringObj(connid->id, -1);
+            objvx[1] = PgConnHandleObj(connid);
             returnCode = Pg_sqlite(cData, interp, objc, objvx);
 	    break;
 	}
@@ -683,7 +1126,9 @@ PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
 int
 PgResultCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[])
 {
+    Pg_resultid *resultid = (Pg_resultid *) cData;
     int    objvxi;
+    int    status;
     Tcl_Obj    *objvx[25];
 
     if (objc == 1 || objc > 25)
@@ -703,7 +1148,19 @@ PgResultCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[
 
     objvx[0] = objv[0];
 
-    return Pg_result(cData, interp, objc + 1, objvx);
+    /*
+     * Hand over the handle's own object, which caches the resultid, rather
+     * than objv[0], which Tcl keeps resolved to this command.
+     */
+    if (resultid->connid != NULL)
+        objvx[1] = resultid->str;
+
+    /* -clear frees the handle's object out from under Pg_result */
+    Tcl_IncrRefCount(objvx[1]);
+    status = Pg_result(cData, interp, objc + 1, objvx);
+    Tcl_DecrRefCount(objvx[1]);
+
+    return status;
 }
 
 /*
@@ -731,10 +1188,202 @@ PgGetConnectionId(Tcl_Interp *interp, const char *id, Pg_ConnectionId ** connid_
 	connid = (Pg_ConnectionId *) Tcl_GetChannelInstanceData(conn_chan);
 	if (connid_p)
 		*connid_p = connid;
+
+	/* Anything else using the connection must wait for a cursor prefetch */
+	if (connid->cursorPrefetch)
+		PgCursorSettle(connid);
+
 	return connid->conn;
 }
 
 
+/*
+ * Get back the connection from a handle object, which remembers the
+ * connection once it has been looked up.
+ */
+PGconn *
+PgGetConnectionIdFromObj(Tcl_Interp *interp, Tcl_Obj *idObj, Pg_ConnectionId ** connid_p)
+{
+	Pg_ConnectionId *connid;
+	PGconn	   *conn;
+
+	if (idObj->typePtr == &connHandleType)
+	{
+		connid = ((Pg_ConnHandle *)idObj->internalRep.twoPtrValue.ptr1)->connid;
+
+		/*
+		 * A command holding the channel open keeps the connid alive after
+		 * a pg_disconnect or close in its body, so then make sure the
+		 * handle still names a channel in this interpreter.
+		 */
+		if (connid != NULL && connid->interp == interp &&
+			(connid->channelHolds == 0 ||
+			 Tcl_IsChannelRegistered(interp, connid->conn_channel)))
+		{
+			if (connid_p)
+				*connid_p = connid;
+
+			/* Anything else using the connection must wait for a cursor prefetch */
+			if (connid->cursorPrefetch)
+				PgCursorSettle(connid);
+
+			return connid->conn;
+		}
+	}
+
+	conn = PgGetConnectionId(interp, Tcl_GetString(idObj), &connid);
+	if (connid != NULL)
+		PgCacheConnectionId(idObj, connid);
+
+	if (connid_p)
+		*connid_p = connid;
+	return conn;
+}
+
+
+/*
+ * A result handle object caches the Pg_resultid it names, so pg_result
+ * finds the result without splitting the handle and looking up the
+ * connection's channel every time.  The resultid is counted by its handle
+ * command and by each object caching it.  When the handle is cleared or
+ * its connection closed the resultid's connid is set to NULL, which tells
+ * the objects their cache is stale; the struct itself goes when the last
+ * of them lets go.
+ */
+static void FreeResultHandleInternalRep(Tcl_Obj *objPtr);
+static void DupResultHandleInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *dupPtr);
+
+static const Tcl_ObjType resultHandleType = {
+	"pgtclResultHandle",
+	FreeResultHandleInternalRep,
+	DupResultHandleInternalRep,
+	NULL,
+	NULL
+};
+
+static void
+PgReleaseResultId(Pg_resultid *resultid)
+{
+	if (--resultid->refCount > 0)
+		return;
+
+	ckfree((void *)resultid);
+}
+
+static void
+FreeResultHandleInternalRep(Tcl_Obj *objPtr)
+{
+	PgReleaseResultId((Pg_resultid *)objPtr->internalRep.twoPtrValue.ptr1);
+	objPtr->typePtr = NULL;
+}
+
+static void
+DupResultHandleInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *dupPtr)
+{
+	Pg_resultid *resultid = (Pg_resultid *)srcPtr->internalRep.twoPtrValue.ptr1;
+
+	resultid->refCount++;
+	dupPtr->internalRep.twoPtrValue.ptr1 = resultid;
+	dupPtr->typePtr = &resultHandleType;
+}
+
+/* Make objPtr, whose string is resultid's handle, remember the resultid */
+static void
+PgCacheResultId(Tcl_Obj *objPtr, Pg_resultid *resultid)
+{
+	/* the string is all that will be left of the old internal rep */
+	Tcl_GetString(objPtr);
+
+	resultid->refCount++;
+	if (objPtr->typePtr && objPtr->typePtr->freeIntRepProc)
+		objPtr->typePtr->freeIntRepProc(objPtr);
+	objPtr->internalRep.twoPtrValue.ptr1 = resultid;
+	objPtr->internalRep.twoPtrValue.ptr2 = NULL;
+	objPtr->typePtr = &resultHandleType;
+}
+
+/*
+ * Let go of everything a resultid holds for its result and mark it dead,
+ * leaving the struct to the handle command and objects that refer to it.
+ */
+static void
+PgClearResultId(Pg_ConnectionId *connid, Pg_resultid *resultid)
+{
+	Tcl_Obj    *str = resultid->str;
+
+	if (resultid->fieldNames != NULL)
+		Tcl_DecrRefCount(resultid->fieldNames);
+	resultid->fieldNames = NULL;
+
+	if ((resultid->nullValueString != NULL) && (resultid->nullValueString != connid->nullValueString))
+		ckfree (resultid->nullValueString);
+	resultid->nullValueString = NULL;
+
+	resultid->connid = NULL;
+
+	/* last, as its cached rep may hold the final reference to resultid */
+	Tcl_DecrRefCount(str);
+}
+
+/*
+ * Take the next free result slot, doubling the tables when there is none.
+ * Freed slots are handed out oldest first, so a handle that was just
+ * cleared doesn't at once name some other result.
+ */
+static int
+PgAllocResultSlot(Pg_ConnectionId *connid)
+{
+	int			resid;
+	int			i;
+
+	if (connid->res_freeHead < 0)
+	{
+		int			old_max = connid->res_max;
+
+		connid->res_max *= 2;
+		connid->results = (PGresult **)ckrealloc((void *)connid->results,
+			sizeof(PGresult *) * connid->res_max);
+		connid->resultids = (Pg_resultid **)ckrealloc((void *)connid->resultids,
+			sizeof(Pg_resultid *) * connid->res_max);
+		connid->res_freeNext = (int *)ckrealloc((void *)connid->res_freeNext,
+			sizeof(int) * connid->res_max);
+
+		for (i = old_max; i < connid->res_max; i++)
+		{
+			connid->results[i] = NULL;
+			connid->resultids[i] = NULL;
+			connid->res_freeNext[i] = i + 1 < connid->res_max ? i + 1 : -1;
+		}
+		connid->res_freeHead = old_max;
+		connid->res_freeTail = connid->res_max - 1;
+	}
+
+	resid = connid->res_freeHead;
+	connid->res_freeHead = connid->res_freeNext[resid];
+	if (connid->res_freeHead < 0)
+		connid->res_freeTail = -1;
+	connid->res_count++;
+
+	return resid;
+}
+
+/* Put a result slot on the end of the free list */
+static void
+PgFreeResultSlot(Pg_ConnectionId *connid, int resid)
+{
+	connid->results[resid] = NULL;
+	connid->resultids[resid] = NULL;
+
+	connid->res_freeNext[resid] = -1;
+	if (connid->res_freeTail < 0)
+		connid->res_freeHead = resid;
+	else
+		connid->res_freeNext[connid->res_freeTail] = resid;
+	connid->res_freeTail = resid;
+	connid->res_count--;
+}
+
+
 /*
  * Remove a connection Id from the hash table and
  * close all portals the user forgot.
@@ -753,28 +1402,32 @@ PgDelConnectionId(DRIVER_DEL_PROTO)
 
 	connid = (Pg_ConnectionId *) cData;
 
+	/* Handle objects still caching the connection must look it up again */
+	connid->handle->connid = NULL;
+	PgReleaseConnHandle(connid->handle);
+	Tcl_DecrRefCount(connid->handleObj);
+	connid->handleObj = NULL;
+
 	for (i = 0; i < connid->res_max; i++)
 	{
 		if (connid->results[i])
 		{
 			PQclear(connid->results[i]);
 
-
+			/*
+			 * The handle command, if it is still around, and any objects
+			 * caching the handle keep the resultid; just mark it dead.
+			 */
 			resultid = connid->resultids[i];
 
-			if (resultid != NULL) {
-				Tcl_DecrRefCount(resultid->str);
-
-				if ((resultid->nullValueString != NULL) && (resultid->nullValueString != connid->nullValueString))
-					ckfree (resultid->nullValueString);
-
-				ckfree((void *)resultid);
-			}
+			if (resultid != NULL)
+				PgClearResultId(connid, resultid);
 		}
 	}
 	
 	ckfree((void *)connid->results);
 	ckfree((void *)connid->resultids);
+	ckfree((void *)connid->res_freeNext);
 
 	/* Release associated notify info */
 	while ((notifies = connid->notify_list) != NULL)
@@ -799,6 +1452,21 @@ PgDelConnectionId(DRIVER_DEL_PROTO)
 	 */
 	PgStopNotifyEventSource(connid, 1);
 
+	/* Stop watching for events on the connection's own channel */
+	PgWatchProc((ClientData) connid, 0);
+
+	/* Forget any pg_select -async still reading from the connection */
+	PgAsyncSelectAbandon(connid);
+
+	/* Delete the handles of cursors on the connection */
+	PgCursorAbandon(connid);
+	PgPrepareCacheFree(connid);
+	PgArenaFree(&connid->arena);
+	if (connid->copyInNull)
+		Tcl_DecrRefCount(connid->copyInNull);
+	if (connid->copyOutRow)
+		PQfreemem(connid->copyOutRow);
+
 	/* Check if the connection has been broken in the background */
 	allow_unregister = PQsocket(connid->conn) >= 0;
 
@@ -861,10 +1529,9 @@ PgDelConnectionId(DRIVER_DEL_PROTO)
  *
  * PgSetResultId --
  *
- *    Find a slot for a new result id.  If the table is full, expand 
- *    it by a factor of 2.  However, do not expand past the hard max, 
- *    as the client is probably just not clearing result handles like 
- *    they should.
+ *    Find a slot for a new result id, growing the tables by a factor
+ *    of 2 when they are full.  PgSetResultIdForConn does the same for
+ *    a caller that has already looked up the connection.
  *
  * Results:
  *    Returns the result id. If the an error occurs, TCL_ERROR is 
@@ -877,71 +1544,29 @@ int
 PgSetResultId(Tcl_Interp *interp, const char *connid_c, PGresult *res, int *idPtr)
 {
     Tcl_Channel     conn_chan;
-    Pg_ConnectionId *connid;
-    int             resid,
-                    i;
-    char            buf[32];
-    Tcl_Obj         *cmd;
-    Pg_resultid     *resultid;
-
 
     conn_chan = Tcl_GetChannel(interp, connid_c, 0);
     if (conn_chan == NULL)
         return TCL_ERROR;
-    connid = (Pg_ConnectionId *) Tcl_GetChannelInstanceData(conn_chan);
 
-    /* search, starting at slot after the last one used */
-    resid = connid->res_last;
-    for (;;)
-    {
-	/* advance, with wraparound */
-        if (++resid >= connid->res_max)
-            resid = 0;
-
-            /* this slot empty? */
-        if (!connid->results[resid])
-        {
-            connid->res_last = resid;
-            break;	/* success exit */
-        }
-
-	/* checked all slots? */
-        if (resid == connid->res_last)
-            break;	/* failure exit */
-    }
-    if (connid->results[resid])
-    {
-        /* no free slot found, so try to enlarge array */
-        if (connid->res_max >= connid->res_hardmax)
-        {
-            Tcl_SetResult(interp, "hard limit on result handles reached",
-					  TCL_STATIC);
-            return TCL_ERROR;
-        }
-
-        connid->res_last = resid = connid->res_max;
-        connid->res_max *= 2;
+    return PgSetResultIdForConn(interp,
+        (Pg_ConnectionId *) Tcl_GetChannelInstanceData(conn_chan), res, idPtr);
+}
 
-        if (connid->res_max > connid->res_hardmax)
-            connid->res_max = connid->res_hardmax;
+int
+PgSetResultIdForConn(Tcl_Interp *interp, Pg_ConnectionId *connid, PGresult *res, int *idPtr)
+{
+    int             resid;
+    char            buf[64];
+    Tcl_Obj         *cmd;
+    Pg_resultid     *resultid;
 
-        connid->results = (PGresult **)ckrealloc((void *)connid->results,
-            sizeof(PGresult *) * connid->res_max);
 
-	connid->resultids = (Pg_resultid **)ckrealloc((void *)connid->resultids,
-            sizeof(Pg_resultid *) * connid->res_max);
-
-        for (i = connid->res_last; i < connid->res_max; i++)
-        {
-            connid->results[i] = NULL;
-			connid->resultids[i] = NULL;
-	}
-
-    }
+    resid = PgAllocResultSlot(connid);
 
     connid->results[resid] = res;
 
-    sprintf(buf, "%s.%d", connid_c, resid);
+    sprintf(buf, "%s.%d", connid->id, resid);
     cmd = Tcl_NewStringObj(buf, -1);
 
     resultid = (Pg_resultid *) ckalloc(sizeof(Pg_resultid));
@@ -949,13 +1574,18 @@ PgSetResultId(Tcl_Interp *interp, const char *connid_c, PGresult *res, int *idPt
     resultid->interp = interp;
     resultid->id     = resid;
     resultid->str = Tcl_NewStringObj(buf, -1);
+    Tcl_IncrRefCount(resultid->str);
     resultid->cmd_token = Tcl_CreateObjCommand(interp, buf, 
         PgResultCmd, (ClientData) resultid, PgDelResultHandle);
 	resultid->connid = connid;
 	resultid->nullValueString = connid->nullValueString;
+	resultid->fieldNames = NULL;
+	resultid->refCount = 1;		/* the handle command's */
 
     connid->resultids[resid] = resultid;
 
+    /* the handle returned already knows its result */
+    PgCacheResultId(cmd, resultid);
     Tcl_SetObjResult(interp, cmd);
 
     *idPtr = resid;
@@ -968,7 +1598,8 @@ static int
 getresid(Tcl_Interp *interp, const char *id, Pg_ConnectionId ** connid_p)
 {
 	Tcl_Channel conn_chan;
-	char	   *mark;
+	const char *mark;
+	Tcl_DString chan_name;
 	int			resid;
 	Pg_ConnectionId *connid;
 
@@ -977,9 +1608,10 @@ getresid(Tcl_Interp *interp, const char *id, Pg_ConnectionId ** connid_p)
 		Tcl_SetResult(interp, "Poorly formated result handle", TCL_STATIC);
 		return -1;
 	}
-	*mark = '\0';
-	conn_chan = Tcl_GetChannel(interp, id, 0);
-	*mark = '.';
+	Tcl_DStringInit(&chan_name);
+	Tcl_DStringAppend(&chan_name, id, mark - id);
+	conn_chan = Tcl_GetChannel(interp, Tcl_DStringValue(&chan_name), 0);
+	Tcl_DStringFree(&chan_name);
 	if (conn_chan == NULL || Tcl_GetChannelType(conn_chan) != &Pg_ConnType)
 	{
 		Tcl_SetResult(interp, "Invalid connection handle", TCL_STATIC);
@@ -1028,6 +1660,44 @@ PgGetResultId(Tcl_Interp *interp, const char *id, Pg_resultid **resultidPtr)
 }
 
 
+/*
+ * Get back the result pointer from a handle object.  The resultid is
+ * cached in the object, so looking up the same handle again is just a
+ * check that the result is still there.
+ */
+PGresult *
+PgGetResultIdFromObj(Tcl_Interp *interp, Tcl_Obj *idObj, Pg_resultid **resultidPtr)
+{
+	Pg_ConnectionId *connid;
+	Pg_resultid *resultid;
+	int			resid;
+
+	if (idObj->typePtr == &resultHandleType)
+	{
+		resultid = (Pg_resultid *)idObj->internalRep.twoPtrValue.ptr1;
+
+		if (resultid->connid != NULL && resultid->interp == interp)
+		{
+			if (resultidPtr != NULL)
+				*resultidPtr = resultid;
+			return resultid->connid->results[resultid->id];
+		}
+	}
+
+	resid = getresid(interp, Tcl_GetString(idObj), &connid);
+	if (resid == -1)
+		return NULL;
+
+	resultid = connid->resultids[resid];
+	if (resultid != NULL)
+		PgCacheResultId(idObj, resultid);
+
+	if (resultidPtr != NULL)
+		*resultidPtr = resultid;
+	return connid->results[resid];
+}
+
+
 /*
  * Remove a result Id from the hash tables
  */
@@ -1042,19 +1712,45 @@ PgDelResultId(Tcl_Interp *interp, const char *id)
 	if (resid == -1)
 		return;
 
-	connid->results[resid] = 0;
-
 	resultid = connid->resultids[resid];
+	PgFreeResultSlot(connid, resid);
+	if (resultid != NULL)
+		PgClearResultId(connid, resultid);
+}
 
-	Tcl_DecrRefCount((Tcl_Obj *)resultid->str);
 
-	if ((resultid->nullValueString != NULL) && (resultid->nullValueString != connid->nullValueString))
-		ckfree (resultid->nullValueString);
+/*
+ * Get the column names of a result as a list of Tcl objects.  The list is
+ * built the first time it's asked for and kept with the result handle, so
+ * that everything that uses the names shares the same objects.  The list
+ * belongs to the result handle; callers must not modify it.
+ */
+Tcl_Obj *
+PgGetResultFieldNames(Pg_resultid *resultid, PGresult *result)
+{
+	int         i;
+	int         nfields;
+	Tcl_Obj    *nameObj;
 
-	ckfree((void *)resultid);
-	connid->resultids[resid] = 0;
-}
+	if (resultid->fieldNames != NULL)
+		return resultid->fieldNames;
 
+	nfields = PQnfields(result);
+	resultid->fieldNames = Tcl_NewListObj(0, NULL);
+	Tcl_IncrRefCount(resultid->fieldNames);
+
+	for (i = 0; i < nfields; i++)
+	{
+		const char *name = PQfname(result, i);
+
+		nameObj = makeUTFStringObj(NULL, name, -1);
+		if (nameObj == NULL)
+			nameObj = Tcl_NewStringObj(name, -1);
+		Tcl_ListObjAppendElement(NULL, resultid->fieldNames, nameObj);
+	}
+
+	return resultid->fieldNames;
+}
 
 /*
  * Get the connection Id from the result Id
@@ -1130,6 +1826,8 @@ typedef struct
 
 /* Dispatch a NotifyEvent that has reached the front of the event queue */
 
+static int Pg_AsyncSelect_EventProc(Tcl_Event *evPtr, int flags);
+
 static int
 Pg_Notify_EventProc(Tcl_Event *evPtr, int flags)
 {
@@ -1311,6 +2009,10 @@ PgConnLossTransferEvents(Pg_ConnectionId * connid)
 	 * connection-loss event.
 	 */
 	PgStopNotifyEventSource(connid, 0);
+
+	/* Let a pg_select -async find out the connection has gone */
+	if (connid->asyncSelect)
+		PgAsyncSelectQueueEvent(connid);
 }
 
 /*
@@ -1358,13 +2060,13 @@ NotifyEventDeleteProc(Tcl_Event *evPtr, ClientData clientData)
 	return 0;
 }
 
-/* This version deletes on-connection-loss events too */
+/* This version deletes on-connection-loss and pg_select -async events too */
 static int
 AllNotifyEventDeleteProc(Tcl_Event *evPtr, ClientData clientData)
 {
 	Pg_ConnectionId *connid = (Pg_ConnectionId *) clientData;
 
-	if (evPtr->proc == Pg_Notify_EventProc)
+	if (evPtr->proc == Pg_Notify_EventProc || evPtr->proc == Pg_AsyncSelect_EventProc)
 	{
 		NotifyEvent *event = (NotifyEvent *) evPtr;
 
@@ -1406,6 +2108,41 @@ Pg_Result_EventProc(Tcl_Event *evPtr, int flags)
     return 1;
 }
 
+/*
+ * Dispatch results to a pg_select -async.  PgAsyncSelectProcess queues
+ * another of these events itself if it stops with results still ready.
+ */
+static int
+Pg_AsyncSelect_EventProc(Tcl_Event *evPtr, int flags)
+{
+	NotifyEvent *event = (NotifyEvent *) evPtr;
+
+	/* Results can only come from file events. */
+	if (!(flags & TCL_FILE_EVENTS))
+		return 0;
+
+	/* The connection may have been closed, or the select finished. */
+	if (event->connid && event->connid->conn && event->connid->asyncSelect)
+	{
+		Tcl_Preserve((ClientData)event->connid);
+		PgAsyncSelectProcess(event->connid);
+		Tcl_Release((ClientData)event->connid);
+	}
+
+	return 1;
+}
+
+void
+PgAsyncSelectQueueEvent(Pg_ConnectionId * connid)
+{
+	NotifyEvent *event = (NotifyEvent *) ckalloc(sizeof(NotifyEvent));
+
+	event->header.proc = Pg_AsyncSelect_EventProc;
+	event->notify = NULL;
+	event->connid = connid;
+	Tcl_QueueEvent((Tcl_Event *) event, TCL_QUEUE_TAIL);
+}
+
 /*
  * File handler callback: called when Tcl has detected read-ready on socket.
  * The clientData is a pointer to the associated connection.
@@ -1444,6 +2181,12 @@ Pg_Notify_FileHandler(ClientData clientData, int mask)
                    Tcl_QueueEvent((Tcl_Event *) event, TCL_QUEUE_TAIL);
                 }
 
+		/* Likewise for a pg_select -async waiting for rows. */
+		if (PQsocket(connid->conn) >= 0
+			&& connid->asyncSelect
+			&& !PQisBusy(connid->conn))
+			PgAsyncSelectQueueEvent(connid);
+
 
 	}
 	else
@@ -1535,7 +2278,7 @@ PgDelCmdHandle(ClientData cData)
         return;
 
 
-    for (i = 0; i <= connid->res_last; i++)
+    for (i = 0; i < connid->res_max; i++)
     {
  
         resultid = connid->resultids[i];
@@ -1556,16 +2299,20 @@ void
 PgDelResultHandle(ClientData cData)
 {
 
-    PGresult       *result;
     Pg_resultid    *resultid = (Pg_resultid *) cData;
-    char           *resstr;
+    Pg_ConnectionId *connid = resultid->connid;
+    PGresult       *result;
 
-    resstr = Tcl_GetString(resultid->str);
-    
-    result = PgGetResultId(resultid->interp, resstr, NULL);
+    /* unless the connection was closed, or the slot freed, first */
+    if (connid != NULL)
+    {
+        result = connid->results[resultid->id];
+        PgFreeResultSlot(connid, resultid->id);
+        PgClearResultId(connid, resultid);
+        PQclear(result);
+    }
 
-    PgDelResultId(resultid->interp, resstr);
-    PQclear(result);
+    PgReleaseResultId(resultid);
 
     return;
 }
@@ -1585,7 +2332,6 @@ Pg_copy_complete(ClientData cData, Tcl_Interp *interp, int objc,
 {
 	Pg_ConnectionId *connid;
 	PGconn	   *conn;
-	char	   *connString;
 	int         errorCode;
 
 	if (objc != 2)
@@ -1594,12 +2340,15 @@ Pg_copy_complete(ClientData cData, Tcl_Interp *interp, int objc,
 		return TCL_ERROR;
 	}
 
-	connString = Tcl_GetString(objv[1]);
-
-	conn = PgGetConnectionId(interp, connString, &connid);
+	conn = PgGetConnectionIdFromObj(interp, objv[1], &connid);
 	if (conn == NULL)
 		return TCL_ERROR;
 
+	if (connid->res_copyStatus == RES_COPY_OWNED) {
+		Tcl_SetResult(interp, "Busy", TCL_STATIC);
+		return TCL_ERROR;
+	}
+
 	if (PgEndCopy(connid, &errorCode, 1) == -1) {
 		char *errorMessage = "I/O Error";
 		if(errorCode == EBUSY) {
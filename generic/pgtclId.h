@@ -15,7 +15,8 @@
  *-------------------------------------------------------------------------
  */
 
-#define RES_HARD_MAX 128
+#include "pgtclArena.h"
+
 #define RES_START 16
 
 /*
@@ -62,16 +63,31 @@ typedef struct Pg_resultid_s
     Tcl_Command        cmd_token;
     char               *nullValueString;
     struct Pg_ConnectionId_s    *connid;
+    Tcl_Obj            *fieldNames;	/* column name list, built on demand */
+    int                refCount;	/* the handle command and objects caching it */
 } Pg_resultid;
 
+/* A pg_select -async in progress; private to pgtclCmds.c */
+typedef struct Pg_AsyncSelect_s Pg_AsyncSelect;
+
+/* A pg_cursor handle; private to pgtclCmds.c */
+typedef struct Pg_Cursor_s Pg_Cursor;
+
+/* A pg_autoprepare statement cache; private to pgtclPrepare.c */
+typedef struct Pg_PrepareCache_s Pg_PrepareCache;
+
+/* What connection handle objects cache; private to pgtclId.c */
+typedef struct Pg_ConnHandle_s Pg_ConnHandle;
+
 typedef struct Pg_ConnectionId_s
 {
 	char		id[32];
 	PGconn	   *conn;
 	int			res_max;		/* Max number of results allocated */
-	int			res_hardmax;	/* Absolute max to allow */
 	int			res_count;		/* Current count of active results */
-	int			res_last;		/* Optimize where to start looking */
+	int		   *res_freeNext;	/* next free slot after each free slot */
+	int			res_freeHead;	/* free slot to use next, or -1 */
+	int			res_freeTail;	/* most recently freed slot, or -1 */
 	int			res_copy;		/* Query result with active copy */
 	int			res_copyStatus; /* Copying status */
 	PGresult  **results;		/* The results */
@@ -87,6 +103,25 @@ typedef struct Pg_ConnectionId_s
 	int			sql_count;       /* number of pg_exec, pg_select, etc, done */
         Tcl_Obj           *callbackPtr;      /* callback for async queries */
         Tcl_Interp        *callbackInterp;   /* interp where the callback should run */
+	Pg_AsyncSelect *asyncSelect;	/* pg_select -async reading results */
+	Pg_Cursor  *cursors;		/* pg_cursor handles on this connection */
+	Pg_Cursor  *cursorPrefetch;	/* pg_cursor with a FETCH in flight */
+	int			cursor_count;	/* number of pg_cursors declared */
+	int			pipelineQueued;	/* pipelined queries not yet synced */
+	int			pipelineSyncs;	/* pipeline syncs not yet read back */
+	Pg_PrepareCache *prepareCache;	/* pg_autoprepare cache, or NULL */
+	Pg_Arena	arena;			/* scratch memory for query commands */
+	Tcl_Obj    *copyInNull;		/* -null of the open pg_copy_in, or NULL */
+	char	   *copyOutRow;		/* COPY OUT row partly read by gets */
+	int			copyOutPos;		/* bytes of copyOutRow already read */
+	int			copyOutLen;		/* length of copyOutRow */
+	int			copyOutEnd;		/* PQgetCopyData's end of COPY OUT, not yet read */
+	Tcl_Channel conn_channel;	/* the connection's own channel */
+	int			channelHolds;	/* commands holding conn_channel open */
+	int			watchMask;		/* events its channel handlers want */
+	Tcl_TimerToken watchTimer;	/* reports data libpq already has */
+	Pg_ConnHandle *handle;		/* shared with objects caching the handle */
+	Tcl_Obj    *handleObj;		/* the handle, already resolved */
 }	Pg_ConnectionId;
 
 
@@ -95,6 +130,7 @@ typedef struct Pg_ConnectionId_s
 #define RES_COPY_NONE	0
 #define RES_COPY_INPROGRESS 1
 #define RES_COPY_FIN	2
+#define RES_COPY_OWNED 3	/* a command is running the COPY itself */
 
 
 extern int PgSetConnectionId(Tcl_Interp *interp, PGconn *conn, char *connhandle);
@@ -107,18 +143,29 @@ extern int PgSetConnectionId(Tcl_Interp *interp, PGconn *conn, char *connhandle)
 
 extern PGconn *PgGetConnectionId(Tcl_Interp *interp, const char *id,
 				  Pg_ConnectionId **);
+extern PGconn *PgGetConnectionIdFromObj(Tcl_Interp *interp, Tcl_Obj *idObj,
+				  Pg_ConnectionId **);
 extern int	PgDelConnectionId(DRIVER_DEL_PROTO);
 extern int	PgOutputProc(DRIVER_OUTPUT_PROTO);
 extern int	PgInputProc(DRIVER_INPUT_PROTO);
 extern int	PgSetResultId(Tcl_Interp *interp, const char *connid, PGresult *res, int *idPtr);
+extern int	PgSetResultIdForConn(Tcl_Interp *interp, Pg_ConnectionId *connid, PGresult *res, int *idPtr);
 extern PGresult *PgGetResultId(Tcl_Interp *interp, const char *id, Pg_resultid **resultidPtr);
+extern PGresult *PgGetResultIdFromObj(Tcl_Interp *interp, Tcl_Obj *idObj, Pg_resultid **resultidPtr);
 extern void PgDelResultId(Tcl_Interp *interp, const char *id);
 extern int	PgGetConnByResultId(Tcl_Interp *interp, const char *resid);
+extern Tcl_Obj *PgGetResultFieldNames(Pg_resultid *resultid, PGresult *result);
 extern void PgStartNotifyEventSource(Pg_ConnectionId * connid);
 extern void PgStopNotifyEventSource(Pg_ConnectionId * connid, pqbool allevents);
 extern void PgNotifyTransferEvents(Pg_ConnectionId * connid);
 extern void PgConnLossTransferEvents(Pg_ConnectionId * connid);
 extern void PgNotifyInterpDelete(ClientData clientData, Tcl_Interp *interp);
+extern void PgAsyncSelectQueueEvent(Pg_ConnectionId * connid);
+extern void PgAsyncSelectProcess(Pg_ConnectionId * connid);
+extern void PgAsyncSelectAbandon(Pg_ConnectionId * connid);
+extern void PgCursorSettle(Pg_ConnectionId * connid);
+extern void PgCursorAbandon(Pg_ConnectionId * connid);
+extern const char *PgResultTimeZone(const PGresult *result);
 
 extern int PgConnCmd(ClientData cData, Tcl_Interp *interp, int objc, Tcl_Obj *CONST objv[]);
 extern void PgDelCmdHandle(ClientData cData);
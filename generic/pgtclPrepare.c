@@ -0,0 +1,431 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgtclPrepare.c
+ *	  per-connection cache of automatically prepared statements
+ *
+ *	Parameterized queries normally go to the server with PQexecParams,
+ *	which parses and plans them afresh on every call.  pg_autoprepare
+ *	turns on a cache, keyed by the query text as sent to the server,
+ *	that counts how often each query is run.  Once a query has been run
+ *	threshold times it is prepared under a generated name, and from then
+ *	on it is run with PQexecPrepared.
+ *
+ *	The cache remembers at most size queries, prepared or still being
+ *	counted.  The least recently used one is dropped to make room, with
+ *	a DEALLOCATE if it had been prepared.  A DEALLOCATE can't be done in
+ *	a failed transaction block, so then the statement name is kept and
+ *	deallocated once the connection is out of the transaction.
+ *
+ *	Prepared statements belong to the server session, so the cache is
+ *	emptied when the backend behind the connection changes, or when a
+ *	DISCARD ALL or DEALLOCATE ALL is seen to succeed.  Should a statement
+ *	vanish anyway, the query is run unprepared instead, unless the
+ *	failure aborted a transaction block.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <libpq-fe.h>
+
+#include "pgtclCmds.h"
+#include "pgtclId.h"
+#include "pgtclPrepare.h"
+
+#define PG_PREPARE_NAME		"pgtcl_auto_%u"
+
+typedef struct Pg_PrepareEntry {
+	struct Pg_PrepareEntry *prev;	/* more recently used */
+	struct Pg_PrepareEntry *next;	/* less recently used */
+	Tcl_HashEntry *hashPtr;			/* our entry in the cache's table */
+	int            uses;			/* executions counted */
+	char           name[32];		/* statement name, "" until prepared */
+} Pg_PrepareEntry;
+
+struct Pg_PrepareCache_s {
+	int              threshold;		/* executions before preparing */
+	int              size;			/* most queries remembered */
+	int              backendPid;	/* server session the statements live in */
+	unsigned int     nameCount;		/* for generating statement names */
+	Tcl_HashTable    table;			/* query text -> Pg_PrepareEntry */
+	Pg_PrepareEntry *head;			/* most recently used */
+	Pg_PrepareEntry *tail;			/* least recently used */
+	Tcl_Obj         *pendingObj;	/* statements still to deallocate, or NULL */
+	int              prepared;		/* entries with a statement */
+	Tcl_WideInt      hits;			/* executions as a prepared statement */
+	Tcl_WideInt      misses;		/* executions with PQexecParams */
+	Tcl_WideInt      prepares;		/* statements prepared */
+	Tcl_WideInt      evictions;		/* entries dropped to make room */
+};
+
+static void
+PgPrepareUnlink(Pg_PrepareCache *cache, Pg_PrepareEntry *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		cache->head = entry->next;
+
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+
+	entry->prev = entry->next = NULL;
+}
+
+static void
+PgPrepareLinkHead(Pg_PrepareCache *cache, Pg_PrepareEntry *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+	if (cache->head)
+		cache->head->prev = entry;
+	else
+		cache->tail = entry;
+	cache->head = entry;
+}
+
+/*
+ * PgPrepareDeallocate --
+ *
+ *    Deallocate a statement on the server, or if that can't be done now,
+ *    add it to the ones PgPrepareRetry tries again.
+ */
+static void
+PgPrepareDeallocate(PGconn *conn, Pg_PrepareCache *cache, const char *name)
+{
+	PGTransactionStatusType status = PQtransactionStatus(conn);
+	PGresult               *result;
+	int                     ok = 0;
+
+	if (status == PQTRANS_IDLE || status == PQTRANS_INTRANS)
+	{
+		char sql[64];
+
+		snprintf(sql, sizeof sql, "DEALLOCATE %s", name);
+		result = PQexec(conn, sql);
+		ok = result != NULL && PQresultStatus(result) == PGRES_COMMAND_OK;
+		PQclear(result);
+	}
+
+	if (!ok)
+	{
+		if (cache->pendingObj == NULL) {
+			cache->pendingObj = Tcl_NewListObj(0, NULL);
+			Tcl_IncrRefCount(cache->pendingObj);
+		}
+		Tcl_ListObjAppendElement(NULL, cache->pendingObj, Tcl_NewStringObj(name, -1));
+	}
+}
+
+/*
+ * PgPrepareRetry --
+ *
+ *    Deallocate the statements that couldn't be when they were dropped,
+ *    once the connection is outside a transaction block.
+ */
+static void
+PgPrepareRetry(PGconn *conn, Pg_PrepareCache *cache)
+{
+	Tcl_Obj  *pendingObj = cache->pendingObj;
+	Tcl_Obj **nameObjs;
+	int       nnames;
+	int       i;
+
+	if (pendingObj == NULL || PQtransactionStatus(conn) != PQTRANS_IDLE)
+		return;
+
+	cache->pendingObj = NULL;
+	Tcl_ListObjGetElements(NULL, pendingObj, &nnames, &nameObjs);
+	for (i = 0; i < nnames; i++)
+		PgPrepareDeallocate(conn, cache, Tcl_GetString(nameObjs[i]));
+	Tcl_DecrRefCount(pendingObj);
+}
+
+/*
+ * PgPrepareForget --
+ *
+ *    The session's statements are gone, so stop waiting to deallocate any.
+ */
+static void
+PgPrepareForget(Pg_PrepareCache *cache)
+{
+	if (cache->pendingObj) {
+		Tcl_DecrRefCount(cache->pendingObj);
+		cache->pendingObj = NULL;
+	}
+}
+
+/*
+ * PgPrepareDrop --
+ *
+ *    Remove an entry from the cache.  If deallocate, a statement that
+ *    was prepared for it is deallocated on the server as well.
+ */
+static void
+PgPrepareDrop(PGconn *conn, Pg_PrepareCache *cache, Pg_PrepareEntry *entry, int deallocate)
+{
+	if (entry->name[0] != '\0')
+	{
+		if (deallocate)
+			PgPrepareDeallocate(conn, cache, entry->name);
+		cache->prepared--;
+	}
+
+	PgPrepareUnlink(cache, entry);
+	Tcl_DeleteHashEntry(entry->hashPtr);
+	ckfree((char *)entry);
+}
+
+static void
+PgPrepareFlush(PGconn *conn, Pg_PrepareCache *cache, int deallocate)
+{
+	while (cache->head)
+		PgPrepareDrop(conn, cache, cache->head, deallocate);
+}
+
+/*
+ * PgPrepareTrim --
+ *
+ *    Drop least recently used entries until at most size remain, sparing
+ *    keep.
+ */
+static void
+PgPrepareTrim(PGconn *conn, Pg_PrepareCache *cache, Pg_PrepareEntry *keep)
+{
+	while (cache->table.numEntries > cache->size && cache->tail && cache->tail != keep)
+	{
+		cache->evictions++;
+		PgPrepareDrop(conn, cache, cache->tail, 1);
+	}
+}
+
+/*
+ * PgExecParams --
+ *
+ *    PQexecParams, going through the connection's prepared statement
+ *    cache if it has one.  Only text parameters whose types the server
+ *    works out are cached, so that the query text alone identifies the
+ *    statement.
+ */
+PGresult *
+PgExecParams(Pg_ConnectionId *connid, const char *query, int nParams, const Oid *paramTypes,
+			 const char *const *paramValues, const int *paramLengths, const int *paramFormats,
+			 int resultFormat)
+{
+	Pg_PrepareCache *cache = connid->prepareCache;
+	PGconn          *conn = connid->conn;
+	Pg_PrepareEntry *entry;
+	Tcl_HashEntry   *hashPtr;
+	PGresult        *result;
+	const char      *sqlState;
+	int              isNew;
+
+	if (cache == NULL || nParams == 0 || paramTypes != NULL)
+		return PQexecParams(conn, query, nParams, paramTypes, paramValues, paramLengths, paramFormats, resultFormat);
+
+	if (PQbackendPID(conn) != cache->backendPid)
+	{
+		/* a new session; whatever we prepared is gone */
+		PgPrepareFlush(conn, cache, 0);
+		PgPrepareForget(cache);
+		cache->backendPid = PQbackendPID(conn);
+	}
+
+	PgPrepareRetry(conn, cache);
+
+	hashPtr = Tcl_CreateHashEntry(&cache->table, query, &isNew);
+	if (isNew)
+	{
+		entry = (Pg_PrepareEntry *)ckalloc(sizeof (Pg_PrepareEntry));
+		entry->hashPtr = hashPtr;
+		entry->uses = 0;
+		entry->name[0] = '\0';
+		Tcl_SetHashValue(hashPtr, entry);
+		PgPrepareLinkHead(cache, entry);
+		PgPrepareTrim(conn, cache, entry);
+	}
+	else
+	{
+		entry = (Pg_PrepareEntry *)Tcl_GetHashValue(hashPtr);
+		PgPrepareUnlink(cache, entry);
+		PgPrepareLinkHead(cache, entry);
+	}
+
+	entry->uses++;
+
+	if (entry->name[0] == '\0' && entry->uses >= cache->threshold)
+	{
+		char name[32];
+
+		snprintf(name, sizeof name, PG_PREPARE_NAME, ++cache->nameCount);
+		result = PQprepare(conn, name, query, nParams, NULL);
+		if (result == NULL || PQresultStatus(result) != PGRES_COMMAND_OK) {
+			/* the query can't be run unprepared either; this is its error */
+			cache->misses++;
+			return result;
+		}
+		PQclear(result);
+
+		strcpy(entry->name, name);
+		cache->prepared++;
+		cache->prepares++;
+	}
+
+	if (entry->name[0] == '\0')
+	{
+		cache->misses++;
+		return PQexecParams(conn, query, nParams, NULL, paramValues, paramLengths, paramFormats, resultFormat);
+	}
+
+	cache->hits++;
+	result = PQexecPrepared(conn, entry->name, nParams, paramValues, paramLengths, paramFormats, resultFormat);
+
+	if (result != NULL && PQresultStatus(result) == PGRES_FATAL_ERROR
+		&& (sqlState = PQresultErrorField(result, PG_DIAG_SQLSTATE)) != NULL
+		&& strcmp(sqlState, "26000") == 0)
+	{
+		/* invalid_sql_statement_name: deallocated behind our back */
+		entry->name[0] = '\0';
+		entry->uses = 0;
+		cache->prepared--;
+
+		if (PQtransactionStatus(conn) == PQTRANS_IDLE) {
+			PQclear(result);
+			cache->hits--;
+			cache->misses++;
+			result = PQexecParams(conn, query, nParams, NULL, paramValues, paramLengths, paramFormats, resultFormat);
+		}
+	}
+
+	return result;
+}
+
+/*
+ * PgPrepareCacheNote --
+ *
+ *    Look at the result of a command run on a connection for the ones
+ *    that deallocate every prepared statement, and forget ours if so.
+ */
+void
+PgPrepareCacheNote(Pg_ConnectionId *connid, PGresult *result)
+{
+	const char *status;
+
+	if (connid->prepareCache == NULL || result == NULL || PQresultStatus(result) != PGRES_COMMAND_OK)
+		return;
+
+	status = PQcmdStatus(result);
+	if (strcmp(status, "DISCARD ALL") == 0 || strcmp(status, "DEALLOCATE ALL") == 0) {
+		PgPrepareFlush(connid->conn, connid->prepareCache, 0);
+		PgPrepareForget(connid->prepareCache);
+	}
+}
+
+/*
+ * PgPrepareCacheConfigure --
+ *
+ *    Turn a connection's cache on, or change its settings.  A threshold
+ *    of zero or less turns it off, deallocating its statements.
+ */
+void
+PgPrepareCacheConfigure(Pg_ConnectionId *connid, int threshold, int size)
+{
+	Pg_PrepareCache *cache = connid->prepareCache;
+
+	if (threshold <= 0)
+	{
+		if (cache == NULL)
+			return;
+
+		if (PQbackendPID(connid->conn) != cache->backendPid) {
+			PgPrepareFlush(connid->conn, cache, 0);
+			PgPrepareForget(cache);
+		}
+		PgPrepareRetry(connid->conn, cache);
+		PgPrepareFlush(connid->conn, cache, 1);
+		PgPrepareCacheFree(connid);
+		return;
+	}
+
+	if (cache == NULL)
+	{
+		cache = (Pg_PrepareCache *)ckalloc(sizeof (Pg_PrepareCache));
+		memset(cache, 0, sizeof (Pg_PrepareCache));
+		Tcl_InitHashTable(&cache->table, TCL_STRING_KEYS);
+		cache->backendPid = PQbackendPID(connid->conn);
+		connid->prepareCache = cache;
+	}
+
+	cache->threshold = threshold;
+	cache->size = size > 0 ? size : 1;
+	PgPrepareTrim(connid->conn, cache, NULL);
+}
+
+/*
+ * PgPrepareCacheFree --
+ *
+ *    Throw away a connection's cache, leaving the server alone.
+ */
+void
+PgPrepareCacheFree(Pg_ConnectionId *connid)
+{
+	Pg_PrepareCache *cache = connid->prepareCache;
+
+	if (cache == NULL)
+		return;
+
+	PgPrepareFlush(connid->conn, cache, 0);
+	PgPrepareForget(cache);
+	Tcl_DeleteHashTable(&cache->table);
+	ckfree((char *)cache);
+	connid->prepareCache = NULL;
+}
+
+/*
+ * PgPrepareCacheSettings --
+ *
+ *    The threshold and size of a connection's cache, both 0 if it's off.
+ */
+Tcl_Obj *
+PgPrepareCacheSettings(Pg_ConnectionId *connid)
+{
+	Pg_PrepareCache *cache = connid->prepareCache;
+	Tcl_Obj         *listObj = Tcl_NewListObj(0, NULL);
+
+	Tcl_ListObjAppendElement(NULL, listObj, Tcl_NewIntObj(cache ? cache->threshold : 0));
+	Tcl_ListObjAppendElement(NULL, listObj, Tcl_NewIntObj(cache ? cache->size : 0));
+	return listObj;
+}
+
+/*
+ * PgPrepareCacheStats --
+ *
+ *    A dictionary of a connection's cache settings and counters, for
+ *    pg_dbinfo prepare_cache.
+ */
+Tcl_Obj *
+PgPrepareCacheStats(Pg_ConnectionId *connid)
+{
+	Pg_PrepareCache *cache = connid->prepareCache;
+	Tcl_Obj         *listObj = Tcl_NewListObj(0, NULL);
+
+#define PG_PREPARE_STAT(name, valueObj) \
+	Tcl_ListObjAppendElement(NULL, listObj, Tcl_NewStringObj(name, -1)); \
+	Tcl_ListObjAppendElement(NULL, listObj, valueObj)
+
+	PG_PREPARE_STAT("threshold", Tcl_NewIntObj(cache ? cache->threshold : 0));
+	PG_PREPARE_STAT("size", Tcl_NewIntObj(cache ? cache->size : 0));
+	PG_PREPARE_STAT("entries", Tcl_NewIntObj(cache ? cache->table.numEntries : 0));
+	PG_PREPARE_STAT("prepared", Tcl_NewIntObj(cache ? cache->prepared : 0));
+	PG_PREPARE_STAT("hits", Tcl_NewWideIntObj(cache ? cache->hits : 0));
+	PG_PREPARE_STAT("misses", Tcl_NewWideIntObj(cache ? cache->misses : 0));
+	PG_PREPARE_STAT("prepares", Tcl_NewWideIntObj(cache ? cache->prepares : 0));
+	PG_PREPARE_STAT("evictions", Tcl_NewWideIntObj(cache ? cache->evictions : 0));
+
+#undef PG_PREPARE_STAT
+
+	return listObj;
+}
@@ -0,0 +1,25 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgtclPrepare.h
+ *	  per-connection cache of automatically prepared statements
+ *
+ *	Include after pgtclCmds.h and pgtclId.h.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PGTCLPREPARE_H
+#define PGTCLPREPARE_H
+
+#define PG_PREPARE_DEFAULT_SIZE	100		/* statements kept if not told otherwise */
+
+extern PGresult *PgExecParams(Pg_ConnectionId *connid, const char *query, int nParams,
+							  const Oid *paramTypes, const char *const *paramValues,
+							  const int *paramLengths, const int *paramFormats, int resultFormat);
+extern void PgPrepareCacheNote(Pg_ConnectionId *connid, PGresult *result);
+extern void PgPrepareCacheConfigure(Pg_ConnectionId *connid, int threshold, int size);
+extern void PgPrepareCacheFree(Pg_ConnectionId *connid);
+extern Tcl_Obj *PgPrepareCacheSettings(Pg_ConnectionId *connid);
+extern Tcl_Obj *PgPrepareCacheStats(Pg_ConnectionId *connid);
+
+#endif
@@ -965,7 +965,7 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 		incoming[CMD_READ_TABSEP] = 1;
 		incoming[CMD_READ_KEYVAL] = 1;
 		argerr[CMD_READ_TABSEP] = "?-row tabsep_row? ?-file file_handle? ?-sql sqlite_sql? ?-create new_table? ?-into table? ?-as name-type-list? ?-types type-list? ?-names name-list? ?-pkey primary_key? ?-sep sepstring? ?-null nullstring? ?-replace? ?-poll_interval count? ?-check?";
-		argerr[CMD_IMPORT_POSTGRES_RESULT] = "handle ?-sql sqlite_sql? ?-create new_table? ?-into table? ?-as name-type-list? ?-types type-list? ?-names name-list? ?-rowbyrow? ?-pkey primary_key? ?-null nullstring? ?-replace? ?-poll_interval count? ?-check? ?-max col varname?";
+		argerr[CMD_IMPORT_POSTGRES_RESULT] = "handle ?-sql sqlite_sql? ?-create new_table? ?-into table? ?-as name-type-list? ?-types type-list? ?-names name-list? ?-rowbyrow? ?-chunk n? ?-pkey primary_key? ?-null nullstring? ?-replace? ?-poll_interval count? ?-check? ?-max col varname?";
 		argerr[CMD_READ_KEYVAL] = "?-row tabsep_row? ?-file file_handle? ?-create new_table? ?-into table? ?-as name-type-list? ?-names name-list? ?-pkey primary_key? ?-sep sepstring? ?-unknown colname? ?-replace? ?-poll_interval count?";
 	}
 
@@ -980,6 +980,7 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 	Tcl_Obj           *nameTypeList = NULL;
 	Tcl_Obj           *nameList = NULL;
 	int                rowbyrow = 0;
+	int                chunkSize = 0;
 	int                returnCode = TCL_OK;
 	const char        *errorMessage = NULL;
 	enum mappedTypes  *columnTypes = NULL;
@@ -1124,6 +1125,19 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 				optIndex++;
 			} else if (cmdIndex == CMD_IMPORT_POSTGRES_RESULT && strcmp(optName, "-rowbyrow") == 0) {
 				rowbyrow = 1;
+			} else if (cmdIndex == CMD_IMPORT_POSTGRES_RESULT && strcmp(optName, "-chunk") == 0) {
+				if(optIndex >= objc) {
+					Tcl_AppendResult(interp, "No row count provided for -chunk", (char *)NULL);
+					return TCL_ERROR;
+				}
+				if(Tcl_GetIntFromObj(interp, objv[optIndex], &chunkSize) != TCL_OK)
+					return TCL_ERROR;
+				if(chunkSize < 1) {
+					Tcl_AppendResult(interp, "-chunk requires a positive row count", (char *)NULL);
+					return TCL_ERROR;
+				}
+				optIndex++;
+				rowbyrow = 1;
 			} else if (cmdIndex != CMD_READ_KEYVAL && strcmp(optName, "-check") == 0) {
 				checkRow = 1;
 			} else if (strcmp(optName, "-replace") == 0) {
@@ -1689,7 +1703,7 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 					returnCode = TCL_ERROR;
 					goto import_cleanup_and_exit;
 				}
-				PQsetSingleRowMode(conn);
+				PgSetRowMode(conn, chunkSize);
 				result = PQgetResult(conn);
 			} else {
 				result = PgGetResultId(interp, pghandle_name, &resultid);
@@ -1714,10 +1728,13 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 				}
 			}
 
+			// One columns array serves every row
+			columns = (char **)ckalloc(nColumns * (sizeof *columns));
+
 			while(result) {
 				status = PQresultStatus(result);
 
-				if(status != PGRES_TUPLES_OK && status != PGRES_SINGLE_TUPLE) {
+				if(!PG_ROWS_STATUS(status)) {
 					errorMessage = PQresultErrorMessage(result);
 					if (!*errorMessage)
 						errorMessage = PQresStatus(status);
@@ -1729,7 +1746,6 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 				nTuples = PQntuples(result);
 
 				for (tupleIndex = 0; tupleIndex < nTuples; tupleIndex++) {
-					char **columns = (char **)ckalloc(nColumns * (sizeof *columns));
 					int gotMax = 1;
 					for(column = 0; column < nColumns; column++) {
 						if(PQgetisnull(result, tupleIndex, column)) {
@@ -1747,11 +1763,9 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 						int check = Pg_sqlite_executeCheck(interp, sqlite_db, checkStatement, primaryKeyIndex, columnTypes, columns, nColumns);
 						if(check == TCL_ERROR) {
 							returnCode = TCL_ERROR;
-							ckfree((void *)columns);
 							goto import_cleanup_and_exit;
 						}
 						if (check == TCL_CONTINUE) {
-							ckfree((void *)columns);
 							continue;
 						}
 					}
@@ -1762,7 +1776,6 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 						int type = columnTypes ? columnTypes[column] : PG_SQLITE_TEXT;
 						if (Pg_sqlite_bindValue(sqlite_db, statement, column, columns[column], type, &errorMessage) != TCL_OK) {
 							returnCode = TCL_ERROR;
-							ckfree((void *)columns);
 							goto import_cleanup_and_exit;
 						}
 					}
@@ -1795,8 +1808,6 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 							}
 						}
 					}
-					ckfree((void *)columns);
-					columns = NULL;
 					if (sqlite3_step(statement) != SQLITE_DONE) {
 						errorMessage = sqlite3_errmsg(sqlite_db);
 						returnCode = TCL_ERROR;
@@ -1867,6 +1878,9 @@ Pg_sqlite(ClientData clientdata, Tcl_Interp *interp, int objc, Tcl_Obj *CONST ob
 			if(columnTypes)
 				ckfree((void *)columnTypes);
 
+			if(columns)
+				ckfree((void *)columns);
+
 			if(sqliteCodeObj)
 				Tcl_DecrRefCount(sqliteCodeObj);
 
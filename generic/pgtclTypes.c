@@ -0,0 +1,1124 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgtclTypes.c
+ *	  conversion of PostgreSQL field values to native Tcl objects
+ *
+ *	Field values normally come back from the server as text.  For the
+ *	well known numeric and boolean types the -typed option of pg_result,
+ *	pg_select and pg_execute hands them to Tcl already parsed, so that
+ *	the first expr or incr on them doesn't have to.  The string form of
+ *	every object is exactly what the server sent.
+ *
+ *	With -binresults the server sends values in its binary wire format
+ *	instead, and PgNewBinaryObj decodes them straight into integers,
+ *	doubles, byte arrays and lists.  Types it doesn't know come back as
+ *	byte arrays holding the raw bytes.
+ *
+ *	Going the other way, PgBinaryParam sends query parameters in binary
+ *	when their type is given or can be told from the object, so byte
+ *	arrays don't need escaping and numbers don't need formatting.
+ *
+ *	PgPackColumn turns a whole numeric column into one byte array of
+ *	native values for vector code, without a Tcl object per value.
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <float.h>
+#include <stdio.h>
+#include <libpq-fe.h>
+
+#include "pgtclCmds.h"
+#include "pgtclTypes.h"
+
+/*
+ * PgTypedKind --
+ *
+ *    Map a column's type OID to the kind of Tcl object -typed makes for it.
+ */
+Pg_TypedKind
+PgTypedKind(Oid type)
+{
+	switch (type)
+	{
+		case PG_TYPE_INT2:
+		case PG_TYPE_INT4:
+		case PG_TYPE_INT8:
+		case PG_TYPE_OID:
+			return PG_TYPED_INTEGER;
+
+		case PG_TYPE_FLOAT4:
+		case PG_TYPE_FLOAT8:
+			return PG_TYPED_DOUBLE;
+
+		case PG_TYPE_BOOL:
+			return PG_TYPED_BOOLEAN;
+
+		case PG_TYPE_NUMERIC:
+			return PG_TYPED_NUMERIC;
+
+		default:
+			return PG_TYPED_STRING;
+	}
+}
+
+/*
+ * PgNewTypedObj --
+ *
+ *    Make a Tcl object for a non-NULL field value of the given kind.
+ *
+ *    Integers are made directly as wide integer objects, since the server
+ *    prints them the same way Tcl does.  Everything else keeps the text
+ *    from the server as its string and is given the matching internal
+ *    representation up front, so "t" stays "t" and 0.1 stays 0.1 while
+ *    still being ready for use as a boolean or number.  A value Tcl can't
+ *    parse (NaN, say) is just left as a string.
+ *
+ * Results:
+ *    A new object, or NULL with an error in interp if the text couldn't
+ *    be converted from external UTF-8.
+ */
+Tcl_Obj *
+PgNewTypedObj(Tcl_Interp *interp, Pg_TypedKind kind, const char *value, int length)
+{
+	Tcl_Obj    *obj;
+	Tcl_WideInt wideValue;
+	double      doubleValue;
+	int         boolValue;
+	char       *end;
+
+	switch (kind)
+	{
+		case PG_TYPED_INTEGER:
+			errno = 0;
+			wideValue = strtoll(value, &end, 10);
+			if (errno == 0 && end == value + length && length > 0)
+				return Tcl_NewWideIntObj(wideValue);
+			break;
+
+		case PG_TYPED_DOUBLE:
+			obj = Tcl_NewStringObj(value, length);
+			Tcl_GetDoubleFromObj(NULL, obj, &doubleValue);
+			return obj;
+
+		case PG_TYPED_BOOLEAN:
+			obj = Tcl_NewStringObj(value, length);
+			Tcl_GetBooleanFromObj(NULL, obj, &boolValue);
+			return obj;
+
+		case PG_TYPED_NUMERIC:
+			obj = Tcl_NewStringObj(value, length);
+			if (strpbrk(value, ".eEIN") != NULL) {
+				Tcl_GetDoubleFromObj(NULL, obj, &doubleValue);
+			} else {
+				/* leaves a bignum behind if it doesn't fit */
+				Tcl_GetWideIntFromObj(NULL, obj, &wideValue);
+			}
+			return obj;
+
+		case PG_TYPED_STRING:
+			break;
+	}
+
+	return makeUTFStringObj(interp, value, length);
+}
+
+
+/*
+ * Binary format decoding
+ *
+ * All binary values are in network byte order.  The layouts are those of
+ * the server's *send functions (int4send, numeric_send, array_send...).
+ */
+
+#define PG_EPOCH_JDATE		2451545		/* Julian day of 2000-01-01 */
+#define PG_USECS_PER_DAY	INT64_C(86400000000)
+
+#define PG_NUMERIC_NEG		0x4000
+#define PG_NUMERIC_NAN		0xC000
+#define PG_NUMERIC_PINF		0xD000
+#define PG_NUMERIC_NINF		0xF000
+
+static unsigned int
+pgGetUint16(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 8) | p[1];
+}
+
+static unsigned int
+pgGetUint32(const unsigned char *p)
+{
+	return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+	       ((unsigned int)p[2] << 8) | p[3];
+}
+
+static Tcl_WideUInt
+pgGetUint64(const unsigned char *p)
+{
+	return ((Tcl_WideUInt)pgGetUint32(p) << 32) | pgGetUint32(p + 4);
+}
+
+static Tcl_Obj *
+pgMalformed(Tcl_Interp *interp, Oid type)
+{
+	if (interp)
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf("malformed binary value for type %u", (unsigned)type));
+	return NULL;
+}
+
+/*
+ * pgJulianToDate --
+ *
+ *    The server's j2date: Julian day number to year, month and day.
+ */
+static void
+pgJulianToDate(int jd, int *year, int *month, int *day)
+{
+	unsigned int julian;
+	unsigned int quad;
+	unsigned int extra;
+	int          y;
+
+	julian = jd;
+	julian += 32044;
+	quad = julian / 146097;
+	extra = (julian - quad * 146097) * 4 + 3;
+	julian += 60 + quad * 3 + extra / 146097;
+	quad = julian / 1461;
+	julian -= quad * 1461;
+	y = julian * 4 / 1461;
+	julian = ((y != 0) ? ((julian + 305) % 365) : ((julian + 306) % 366)) + 123;
+	y += quad * 4;
+	*year = y - 4800;
+	quad = julian * 2141 / 65536;
+	*day = julian - 7834 * quad / 256;
+	*month = (quad + 10) % 12 + 1;
+}
+
+/*
+ * pgFormatDate --
+ *
+ *    Write days since 2000-01-01 as an ISO date, returning the number of
+ *    characters written.  *bc is set for dates before year 1, whose
+ *    " BC" suffix has to go after any time part.
+ */
+static int
+pgFormatDate(char *buf, int days, int *bc)
+{
+	int year, month, day;
+
+	pgJulianToDate(days + PG_EPOCH_JDATE, &year, &month, &day);
+
+	*bc = year <= 0;
+	if (*bc)
+		year = 1 - year;
+
+	return sprintf(buf, "%04d-%02d-%02d", year, month, day);
+}
+
+static Tcl_Obj *
+pgDecodeDate(int days)
+{
+	char buf[32];
+	int  bc;
+	int  n;
+
+	if (days == INT32_MAX)
+		return Tcl_NewStringObj("infinity", -1);
+	if (days == INT32_MIN)
+		return Tcl_NewStringObj("-infinity", -1);
+
+	n = pgFormatDate(buf, days, &bc);
+	if (bc)
+		n += sprintf(buf + n, " BC");
+
+	return Tcl_NewStringObj(buf, n);
+}
+
+/*
+ * pgZoneOffset --
+ *
+ *    The offset from UTC, in seconds east, of the server's TimeZone
+ *    setting at the given Unix time.  UTC itself is answered directly;
+ *    other zones are looked up with Tcl's clock command, which knows the
+ *    same Olson names the server does.  A zone Tcl doesn't know is taken
+ *    as UTC.
+ */
+static int
+pgZoneOffset(Tcl_Interp *interp, const char *timeZone, Tcl_WideInt seconds)
+{
+	static const char *const utcZones[] = {
+		"UTC", "Etc/UTC", "UCT", "Etc/UCT", "GMT", "Etc/GMT", "Zulu", "Etc/Zulu", "Universal", NULL
+	};
+	Tcl_InterpState state;
+	Tcl_Obj        *objv[7];
+	const char     *zone;
+	int             offset = 0;
+	int             i;
+
+	if (timeZone == NULL || interp == NULL)
+		return 0;
+	for (i = 0; utcZones[i] != NULL; i++) {
+		if (strcmp(timeZone, utcZones[i]) == 0)
+			return 0;
+	}
+
+	objv[0] = Tcl_NewStringObj("::clock", -1);
+	objv[1] = Tcl_NewStringObj("format", -1);
+	objv[2] = Tcl_NewWideIntObj(seconds);
+	objv[3] = Tcl_NewStringObj("-format", -1);
+	objv[4] = Tcl_NewStringObj("%z", -1);
+	objv[5] = Tcl_NewStringObj("-timezone", -1);
+	objv[6] = Tcl_NewStringObj(timeZone, -1);
+	for (i = 0; i < 7; i++)
+		Tcl_IncrRefCount(objv[i]);
+
+	state = Tcl_SaveInterpState(interp, TCL_OK);
+	if (Tcl_EvalObjv(interp, 7, objv, TCL_EVAL_GLOBAL) == TCL_OK) {
+		/* [+-]hhmm, possibly followed by ss */
+		zone = Tcl_GetStringResult(interp);
+		if ((zone[0] == '+' || zone[0] == '-') && strlen(zone) >= 5) {
+			offset = ((zone[1] - '0') * 10 + (zone[2] - '0')) * 3600 + ((zone[3] - '0') * 10 + (zone[4] - '0')) * 60;
+			if (strlen(zone) >= 7)
+				offset += (zone[5] - '0') * 10 + (zone[6] - '0');
+			if (zone[0] == '-')
+				offset = -offset;
+		}
+	}
+	Tcl_RestoreInterpState(interp, state);
+
+	for (i = 0; i < 7; i++)
+		Tcl_DecrRefCount(objv[i]);
+
+	return offset;
+}
+
+/*
+ * pgDecodeTimestamp --
+ *
+ *    Format microseconds since 2000-01-01 00:00:00 the way the server's
+ *    ISO DateStyle does.  timestamptz values are in UTC on the wire; they
+ *    are shown in timeZone, the session's TimeZone when the result was
+ *    made, with its offset ("-05", "+05:30"), as the server's text would.
+ */
+static Tcl_Obj *
+pgDecodeTimestamp(Tcl_Interp *interp, Tcl_WideInt usecs, int withZone, const char *timeZone)
+{
+	char        buf[64];
+	Tcl_WideInt days;
+	Tcl_WideInt time;
+	int         bc;
+	int         n;
+	int         fraction;
+	int         offset = 0;
+
+	if (usecs == INT64_MAX)
+		return Tcl_NewStringObj("infinity", -1);
+	if (usecs == INT64_MIN)
+		return Tcl_NewStringObj("-infinity", -1);
+
+	if (withZone) {
+		Tcl_WideInt seconds = usecs / 1000000 - (usecs % 1000000 < 0);
+
+		/* seconds since 1970-01-01 for the clock command */
+		offset = pgZoneOffset(interp, timeZone, seconds + INT64_C(946684800));
+		usecs += (Tcl_WideInt)offset * 1000000;
+	}
+
+	days = usecs / PG_USECS_PER_DAY;
+	time = usecs % PG_USECS_PER_DAY;
+	if (time < 0) {
+		days--;
+		time += PG_USECS_PER_DAY;
+	}
+
+	n = pgFormatDate(buf, (int)days, &bc);
+	fraction = (int)(time % 1000000);
+	time /= 1000000;
+	n += sprintf(buf + n, " %02d:%02d:%02d", (int)(time / 3600), (int)(time / 60 % 60), (int)(time % 60));
+
+	if (fraction) {
+		n += sprintf(buf + n, ".%06d", fraction);
+		while (buf[n - 1] == '0')
+			n--;
+	}
+
+	if (withZone) {
+		int absOffset = offset < 0 ? -offset : offset;
+
+		n += sprintf(buf + n, "%c%02d", offset < 0 ? '-' : '+', absOffset / 3600);
+		if (absOffset % 3600)
+			n += sprintf(buf + n, ":%02d", absOffset / 60 % 60);
+		if (absOffset % 60)
+			n += sprintf(buf + n, ":%02d", absOffset % 60);
+	}
+	if (bc)
+		n += sprintf(buf + n, " BC");
+
+	return Tcl_NewStringObj(buf, n);
+}
+
+/*
+ * pgDecodeFloat --
+ *
+ *    Format a float4 or float8 the way the server does with its default
+ *    extra_float_digits: the fewest digits that read back as the same
+ *    value of the column's own precision, so a float4 1.1 is "1.1" and not
+ *    the double it widens to.  Exponents are used below 1e-4 and from
+ *    1e6 (float4) or 1e15 (float8) up, and the special values are spelled
+ *    NaN, Infinity and -Infinity.
+ */
+static Tcl_Obj *
+pgDecodeFloat(Tcl_Interp *interp, double value, int isFloat4)
+{
+	char buf[40];
+	int  precision;
+	int  exponent;
+	int  n;
+
+	if (value != value)
+		return Tcl_NewStringObj("NaN", -1);
+	if (value > DBL_MAX)
+		return PgNewTypedObj(interp, PG_TYPED_DOUBLE, "Infinity", 8);
+	if (value < -DBL_MAX)
+		return PgNewTypedObj(interp, PG_TYPED_DOUBLE, "-Infinity", 9);
+
+	for (precision = 1; precision < (isFloat4 ? 9 : 17); precision++) {
+		sprintf(buf, "%.*e", precision - 1, value);
+		if (isFloat4 ? strtof(buf, NULL) == (float)value : strtod(buf, NULL) == value)
+			break;
+	}
+	sprintf(buf, "%.*e", precision - 1, value);
+	exponent = atoi(strchr(buf, 'e') + 1);
+
+	if (exponent >= -4 && exponent < (isFloat4 ? 6 : 15))
+		n = sprintf(buf, "%.*f", precision - 1 - exponent > 0 ? precision - 1 - exponent : 0, value);
+	else
+		n = (int)strlen(buf);
+
+	return PgNewTypedObj(interp, PG_TYPED_DOUBLE, buf, n);
+}
+
+/*
+ * pgDecodeNumeric --
+ *
+ *    Turn the server's base 10000 numeric format back into its text
+ *    form, then make that a -typed numeric object.
+ */
+static Tcl_Obj *
+pgDecodeNumeric(Tcl_Interp *interp, const unsigned char *p, int length)
+{
+	Tcl_DString buf;
+	Tcl_Obj    *obj;
+	int         ndigits;
+	int         weight;
+	int         sign;
+	int         dscale;
+	int         i;
+	char        digits[8];
+
+	if (length < 8)
+		return pgMalformed(interp, PG_TYPE_NUMERIC);
+
+	ndigits = pgGetUint16(p);
+	weight = (short)pgGetUint16(p + 2);
+	sign = pgGetUint16(p + 4);
+	dscale = pgGetUint16(p + 6);
+
+	if (length != 8 + 2 * ndigits)
+		return pgMalformed(interp, PG_TYPE_NUMERIC);
+
+	switch (sign)
+	{
+		case PG_NUMERIC_NAN:
+			return Tcl_NewStringObj("NaN", -1);
+		case PG_NUMERIC_PINF:
+			return Tcl_NewStringObj("Infinity", -1);
+		case PG_NUMERIC_NINF:
+			return Tcl_NewStringObj("-Infinity", -1);
+	}
+
+	p += 8;
+	Tcl_DStringInit(&buf);
+
+	if (sign == PG_NUMERIC_NEG)
+		Tcl_DStringAppend(&buf, "-", 1);
+
+	/* Integer part, each base 10000 digit being four decimal digits */
+	if (weight < 0) {
+		Tcl_DStringAppend(&buf, "0", 1);
+	} else {
+		for (i = 0; i <= weight; i++) {
+			int digit = i < ndigits ? (int)pgGetUint16(p + 2 * i) : 0;
+
+			Tcl_DStringAppend(&buf, digits, sprintf(digits, i == 0 ? "%d" : "%04d", digit));
+		}
+	}
+
+	/* Fraction, cut to dscale decimal digits */
+	if (dscale > 0) {
+		int remaining = dscale;
+
+		Tcl_DStringAppend(&buf, ".", 1);
+		for (i = weight + 1; remaining > 0; i++) {
+			int digit = (i >= 0 && i < ndigits) ? (int)pgGetUint16(p + 2 * i) : 0;
+
+			sprintf(digits, "%04d", digit);
+			Tcl_DStringAppend(&buf, digits, remaining < 4 ? remaining : 4);
+			remaining -= 4;
+		}
+	}
+
+	obj = PgNewTypedObj(interp, PG_TYPED_NUMERIC, Tcl_DStringValue(&buf), Tcl_DStringLength(&buf));
+	Tcl_DStringFree(&buf);
+	return obj;
+}
+
+static Tcl_Obj *
+pgDecodeUuid(const unsigned char *p)
+{
+	char buf[40];
+
+	sprintf(buf, "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+		p[0], p[1], p[2], p[3], p[4], p[5], p[6], p[7],
+		p[8], p[9], p[10], p[11], p[12], p[13], p[14], p[15]);
+
+	return Tcl_NewStringObj(buf, 36);
+}
+
+/*
+ * pgDecodeArrayLevel --
+ *
+ *    Build the Tcl list for one dimension of an array, recursing for the
+ *    inner dimensions.  *pp walks through the element data.  NULL
+ *    elements are empty strings.
+ */
+static Tcl_Obj *
+pgDecodeArrayLevel(Tcl_Interp *interp, Oid arrayType, Oid elemType, const int *dims, int ndim,
+				   const unsigned char **pp, const unsigned char *end, const char *timeZone)
+{
+	Tcl_Obj *listObj = Tcl_NewListObj(0, NULL);
+	Tcl_Obj *elemObj;
+	int      i;
+
+	for (i = 0; i < dims[0]; i++) {
+		if (ndim > 1) {
+			elemObj = pgDecodeArrayLevel(interp, arrayType, elemType, dims + 1, ndim - 1, pp, end, timeZone);
+		} else {
+			int length;
+
+			if (end - *pp < 4)
+				goto malformed;
+			length = (int)pgGetUint32(*pp);
+			*pp += 4;
+
+			if (length == -1) {
+				elemObj = Tcl_NewObj();
+			} else {
+				if (length < 0 || end - *pp < length)
+					goto malformed;
+				elemObj = PgNewBinaryObj(interp, elemType, (const char *)*pp, length, timeZone);
+				*pp += length;
+			}
+		}
+
+		if (elemObj == NULL) {
+			Tcl_DecrRefCount(listObj);
+			return NULL;
+		}
+		Tcl_ListObjAppendElement(NULL, listObj, elemObj);
+	}
+
+	return listObj;
+
+  malformed:
+	Tcl_DecrRefCount(listObj);
+	return pgMalformed(interp, arrayType);
+}
+
+static Tcl_Obj *
+pgDecodeArray(Tcl_Interp *interp, Oid arrayType, const unsigned char *p, int length, const char *timeZone)
+{
+	const unsigned char *end = p + length;
+	int                  ndim;
+	Oid                  elemType;
+	int                  dims[6];	/* the server's MAXDIM */
+	int                  i;
+
+	if (length < 12)
+		return pgMalformed(interp, arrayType);
+
+	ndim = (int)pgGetUint32(p);
+	elemType = pgGetUint32(p + 8);
+	p += 12;
+
+	if (ndim == 0)
+		return Tcl_NewObj();
+	if (ndim < 0 || ndim > 6 || end - p < 8 * ndim)
+		return pgMalformed(interp, arrayType);
+
+	/* Dimensions are (size, lower bound) pairs; the bound isn't kept */
+	for (i = 0; i < ndim; i++) {
+		dims[i] = (int)pgGetUint32(p);
+		if (dims[i] < 0)
+			return pgMalformed(interp, arrayType);
+		p += 8;
+	}
+
+	return pgDecodeArrayLevel(interp, arrayType, elemType, dims, ndim, &p, end, timeZone);
+}
+
+/*
+ * PgNewBinaryObj --
+ *
+ *    Make a Tcl object for a non-NULL field value of the given type sent
+ *    in binary format.  timeZone is the session's TimeZone setting, used
+ *    for timestamptz values; NULL means UTC.
+ *
+ * Results:
+ *    A new object, or NULL with an error in interp if the value is not
+ *    well formed.
+ */
+Tcl_Obj *
+PgNewBinaryObj(Tcl_Interp *interp, Oid type, const char *value, int length, const char *timeZone)
+{
+	const unsigned char *p = (const unsigned char *)value;
+	Tcl_WideUInt         bits64;
+	unsigned int         bits32;
+	float                floatValue;
+	double               doubleValue;
+
+	switch (type)
+	{
+		case PG_TYPE_BOOL:
+			if (length != 1)
+				return pgMalformed(interp, type);
+			/* "t" or "f", as the server would send it as text */
+			return PgNewTypedObj(interp, PG_TYPED_BOOLEAN, p[0] ? "t" : "f", 1);
+
+		case PG_TYPE_INT2:
+			if (length != 2)
+				return pgMalformed(interp, type);
+			return Tcl_NewIntObj((short)pgGetUint16(p));
+
+		case PG_TYPE_INT4:
+			if (length != 4)
+				return pgMalformed(interp, type);
+			return Tcl_NewIntObj((int)pgGetUint32(p));
+
+		case PG_TYPE_OID:
+			if (length != 4)
+				return pgMalformed(interp, type);
+			return Tcl_NewWideIntObj((Tcl_WideInt)pgGetUint32(p));
+
+		case PG_TYPE_INT8:
+			if (length != 8)
+				return pgMalformed(interp, type);
+			return Tcl_NewWideIntObj((Tcl_WideInt)pgGetUint64(p));
+
+		case PG_TYPE_FLOAT4:
+			if (length != 4)
+				return pgMalformed(interp, type);
+			bits32 = pgGetUint32(p);
+			memcpy(&floatValue, &bits32, sizeof floatValue);
+			return pgDecodeFloat(interp, floatValue, 1);
+
+		case PG_TYPE_FLOAT8:
+			if (length != 8)
+				return pgMalformed(interp, type);
+			bits64 = pgGetUint64(p);
+			memcpy(&doubleValue, &bits64, sizeof doubleValue);
+			return pgDecodeFloat(interp, doubleValue, 0);
+
+		case PG_TYPE_BYTEA:
+			return Tcl_NewByteArrayObj(p, length);
+
+		case PG_TYPE_UUID:
+			if (length != 16)
+				return pgMalformed(interp, type);
+			return pgDecodeUuid(p);
+
+		case PG_TYPE_DATE:
+			if (length != 4)
+				return pgMalformed(interp, type);
+			return pgDecodeDate((int)pgGetUint32(p));
+
+		case PG_TYPE_TIMESTAMP:
+		case PG_TYPE_TIMESTAMPTZ:
+			if (length != 8)
+				return pgMalformed(interp, type);
+			return pgDecodeTimestamp(interp, (Tcl_WideInt)pgGetUint64(p), type == PG_TYPE_TIMESTAMPTZ, timeZone);
+
+		case PG_TYPE_NUMERIC:
+			return pgDecodeNumeric(interp, p, length);
+
+		case PG_TYPE_JSONB:
+			/* a version byte, then the text */
+			if (length < 1 || p[0] != 1)
+				return pgMalformed(interp, type);
+			return makeUTFStringObj(interp, value + 1, length - 1);
+
+		case PG_TYPE_TEXT:
+		case PG_TYPE_VARCHAR:
+		case PG_TYPE_BPCHAR:
+		case PG_TYPE_CHAR:
+		case PG_TYPE_NAME:
+		case PG_TYPE_JSON:
+		case PG_TYPE_XML:
+		case PG_TYPE_UNKNOWN:
+			/* the binary form of text types is the text itself */
+			return makeUTFStringObj(interp, value, length);
+
+		case PG_TYPE_BOOL_ARRAY:
+		case PG_TYPE_BYTEA_ARRAY:
+		case PG_TYPE_INT2_ARRAY:
+		case PG_TYPE_INT4_ARRAY:
+		case PG_TYPE_TEXT_ARRAY:
+		case PG_TYPE_BPCHAR_ARRAY:
+		case PG_TYPE_VARCHAR_ARRAY:
+		case PG_TYPE_INT8_ARRAY:
+		case PG_TYPE_FLOAT4_ARRAY:
+		case PG_TYPE_FLOAT8_ARRAY:
+		case PG_TYPE_OID_ARRAY:
+		case PG_TYPE_TIMESTAMP_ARRAY:
+		case PG_TYPE_DATE_ARRAY:
+		case PG_TYPE_TIMESTAMPTZ_ARRAY:
+		case PG_TYPE_NUMERIC_ARRAY:
+		case PG_TYPE_UUID_ARRAY:
+			return pgDecodeArray(interp, type, p, length, timeZone);
+
+		default:
+			return Tcl_NewByteArrayObj(p, length);
+	}
+}
+
+
+/*
+ * Binary format encoding of query parameters
+ */
+
+static void
+pgPutUint16(char *p, unsigned int value)
+{
+	p[0] = (char)(value >> 8);
+	p[1] = (char)value;
+}
+
+static void
+pgPutUint32(char *p, unsigned int value)
+{
+	p[0] = (char)(value >> 24);
+	p[1] = (char)(value >> 16);
+	p[2] = (char)(value >> 8);
+	p[3] = (char)value;
+}
+
+static void
+pgPutUint64(char *p, Tcl_WideUInt value)
+{
+	pgPutUint32(p, (unsigned int)(value >> 32));
+	pgPutUint32(p + 4, (unsigned int)value);
+}
+
+static int
+pgIntegerParam(Tcl_Interp *interp, Tcl_Obj *obj, Oid type, Tcl_WideInt min, Tcl_WideInt max, Tcl_WideInt *valuePtr)
+{
+	if (Tcl_GetWideIntFromObj(interp, obj, valuePtr) != TCL_OK)
+		return TCL_ERROR;
+
+	if (*valuePtr < min || *valuePtr > max) {
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf("parameter \"%s\" out of range for type %u", Tcl_GetString(obj), (unsigned)type));
+		return TCL_ERROR;
+	}
+
+	return TCL_OK;
+}
+
+/*
+ * PgBinaryParam --
+ *
+ *    Work out whether a query parameter goes to the server in binary
+ *    format, and encode it if so.  *typePtr is the parameter's type OID
+ *    from -paramtypes, or 0 to let infer decide from the object's
+ *    internal representation, in which case *typePtr is set to the type
+ *    inferred.  Byte arrays are sent straight from the object; numbers
+ *    are encoded into scratch, which must hold PG_PARAM_SCRATCH bytes.
+ *
+ *    The string "NULL" is left for the caller to send as a NULL.
+ *
+ * Results:
+ *    TCL_OK, with *formatPtr 1 and *valuePtr and *lengthPtr set if the
+ *    value is to be sent in binary, or with *formatPtr 0 if it is to be
+ *    sent as text.  TCL_ERROR, with a message in interp, if the value
+ *    doesn't fit its explicit type.
+ */
+int
+PgBinaryParam(Tcl_Interp *interp, Tcl_Obj *obj, int infer, Oid *typePtr,
+			  const char **valuePtr, int *lengthPtr, int *formatPtr, char *scratch)
+{
+	static const Tcl_ObjType *byteArrayType = NULL;
+	static const Tcl_ObjType *intType = NULL;
+	static const Tcl_ObjType *wideIntType = NULL;
+	static const Tcl_ObjType *doubleType = NULL;
+
+	Oid          type = *typePtr;
+	Tcl_WideInt  wideValue;
+	double       doubleValue;
+	float        floatValue;
+	int          boolValue;
+	unsigned int bits32;
+	Tcl_WideUInt bits64;
+	int          length;
+
+	if (byteArrayType == NULL) {
+		byteArrayType = Tcl_GetObjType("bytearray");
+		intType = Tcl_GetObjType("int");
+		wideIntType = Tcl_GetObjType("wideInt");	/* not on LP64 */
+		doubleType = Tcl_GetObjType("double");
+	}
+
+	*formatPtr = 0;
+
+	if (obj->typePtr != byteArrayType && obj->typePtr != intType &&
+	    obj->typePtr != doubleType && (wideIntType == NULL || obj->typePtr != wideIntType))
+	{
+		const char *string = Tcl_GetStringFromObj(obj, &length);
+
+		if (length == 4 && strcmp(string, "NULL") == 0)
+			return TCL_OK;
+	}
+
+	if (type == 0) {
+		if (infer == PG_INFER_NONE)
+			return TCL_OK;
+
+		if (infer == PG_INFER_RAW) {
+			/*
+			 * pg_sql -binparams: the caller's bytes, for the server to
+			 * interpret.  Anything but a byte array is a string, which
+			 * the caller sends as its UTF-8 bytes.
+			 */
+			if (obj->typePtr != byteArrayType)
+				return TCL_OK;
+			*valuePtr = (const char *)Tcl_GetByteArrayFromObj(obj, lengthPtr);
+			*formatPtr = 1;
+			return TCL_OK;
+		}
+
+		if (obj->typePtr == byteArrayType) {
+			type = PG_TYPE_BYTEA;
+		} else if (infer == PG_INFER_BYTEA) {
+			return TCL_OK;
+		} else if (obj->typePtr == intType || (wideIntType != NULL && obj->typePtr == wideIntType)) {
+			type = PG_TYPE_INT8;
+		} else if (obj->typePtr == doubleType) {
+			type = PG_TYPE_FLOAT8;
+		} else {
+			return TCL_OK;
+		}
+	}
+
+	switch (type)
+	{
+		case PG_TYPE_BOOL:
+			if (Tcl_GetBooleanFromObj(interp, obj, &boolValue) != TCL_OK)
+				return TCL_ERROR;
+			scratch[0] = (char)(boolValue != 0);
+			length = 1;
+			break;
+
+		case PG_TYPE_INT2:
+			if (pgIntegerParam(interp, obj, type, INT16_MIN, INT16_MAX, &wideValue) != TCL_OK)
+				return TCL_ERROR;
+			pgPutUint16(scratch, (unsigned int)wideValue);
+			length = 2;
+			break;
+
+		case PG_TYPE_INT4:
+			if (pgIntegerParam(interp, obj, type, INT32_MIN, INT32_MAX, &wideValue) != TCL_OK)
+				return TCL_ERROR;
+			pgPutUint32(scratch, (unsigned int)wideValue);
+			length = 4;
+			break;
+
+		case PG_TYPE_OID:
+			if (pgIntegerParam(interp, obj, type, 0, UINT32_MAX, &wideValue) != TCL_OK)
+				return TCL_ERROR;
+			pgPutUint32(scratch, (unsigned int)wideValue);
+			length = 4;
+			break;
+
+		case PG_TYPE_INT8:
+			if (Tcl_GetWideIntFromObj(interp, obj, &wideValue) != TCL_OK)
+				return TCL_ERROR;
+			pgPutUint64(scratch, (Tcl_WideUInt)wideValue);
+			length = 8;
+			break;
+
+		case PG_TYPE_FLOAT4:
+			if (Tcl_GetDoubleFromObj(interp, obj, &doubleValue) != TCL_OK)
+				return TCL_ERROR;
+			floatValue = (float)doubleValue;
+			memcpy(&bits32, &floatValue, sizeof bits32);
+			pgPutUint32(scratch, bits32);
+			length = 4;
+			break;
+
+		case PG_TYPE_FLOAT8:
+			if (Tcl_GetDoubleFromObj(interp, obj, &doubleValue) != TCL_OK)
+				return TCL_ERROR;
+			memcpy(&bits64, &doubleValue, sizeof bits64);
+			pgPutUint64(scratch, bits64);
+			length = 8;
+			break;
+
+		case PG_TYPE_BYTEA:
+			*valuePtr = (const char *)Tcl_GetByteArrayFromObj(obj, lengthPtr);
+			*typePtr = type;
+			*formatPtr = 1;
+			return TCL_OK;
+
+		default:
+			/* any other explicit type is sent as text */
+			return TCL_OK;
+	}
+
+	*valuePtr = scratch;
+	*lengthPtr = length;
+	*typePtr = type;
+	*formatPtr = 1;
+	return TCL_OK;
+}
+
+
+/*
+ * Packing a column into a byte array of native machine values
+ */
+
+static const char *pgPackTypeNames[] = {
+	"double", "float", "int32", "int64"
+};
+
+static int
+pgPackBadValue(Tcl_Interp *interp, PGresult *result, int tupno, int column, Pg_PackType packType)
+{
+	if (PQfformat(result, column) == 1) {
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf("cannot pack binary value of type %u in row %d as %s",
+					(unsigned)PQftype(result, column), tupno, pgPackTypeNames[packType]));
+	} else {
+		Tcl_SetObjResult(interp, Tcl_ObjPrintf("value \"%s\" in row %d is not a valid %s",
+					PQgetvalue(result, tupno, column), tupno, pgPackTypeNames[packType]));
+	}
+	return TCL_ERROR;
+}
+
+/*
+ * pgPackBinary --
+ *
+ *    Read a binary format field of one of the numeric or boolean types
+ *    as either a double or an integer, whichever *isDoublePtr says the
+ *    field's type naturally is.
+ */
+static int
+pgPackBinary(Oid type, const unsigned char *p, int length, int *isDoublePtr,
+			 double *doublePtr, Tcl_WideInt *widePtr)
+{
+	unsigned int bits32;
+	Tcl_WideUInt bits64;
+	float        floatValue;
+
+	*isDoublePtr = 0;
+
+	switch (type)
+	{
+		case PG_TYPE_BOOL:
+			if (length != 1)
+				return 0;
+			*widePtr = (p[0] != 0);
+			return 1;
+
+		case PG_TYPE_INT2:
+			if (length != 2)
+				return 0;
+			*widePtr = (int16_t)pgGetUint16(p);
+			return 1;
+
+		case PG_TYPE_INT4:
+			if (length != 4)
+				return 0;
+			*widePtr = (int32_t)pgGetUint32(p);
+			return 1;
+
+		case PG_TYPE_OID:
+			if (length != 4)
+				return 0;
+			*widePtr = pgGetUint32(p);
+			return 1;
+
+		case PG_TYPE_INT8:
+			if (length != 8)
+				return 0;
+			*widePtr = (Tcl_WideInt)pgGetUint64(p);
+			return 1;
+
+		case PG_TYPE_FLOAT4:
+			if (length != 4)
+				return 0;
+			bits32 = pgGetUint32(p);
+			memcpy(&floatValue, &bits32, sizeof floatValue);
+			*doublePtr = floatValue;
+			*isDoublePtr = 1;
+			return 1;
+
+		case PG_TYPE_FLOAT8:
+			if (length != 8)
+				return 0;
+			bits64 = pgGetUint64(p);
+			memcpy(doublePtr, &bits64, sizeof *doublePtr);
+			*isDoublePtr = 1;
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+/*
+ * PgPackColumn --
+ *
+ *    Pack the values of one result column, from tuple firstTuple up to
+ *    but not including endTuple, into a byte array of native
+ *    doubles, floats, 32 bit or 64 bit integers, in the machine's own
+ *    byte order, for handing to numeric extensions without building a
+ *    Tcl object per value.  Text fields are parsed with strtod and
+ *    strtoll, booleans as 0 or 1; binary fields of the numeric types are
+ *    read directly.
+ *
+ *    NULLs are stored as nullDouble or nullWide, depending on whether
+ *    packType is a floating point type.  If bitmapPtr isn't NULL it is also
+ *    set to a byte array with bit (n % 8) of byte (n / 8) set for each
+ *    NULL, n counting from firstTuple.
+ *
+ * Results:
+ *    The byte array, or NULL with a message in interp if a value can't
+ *    be represented in the packed type.
+ */
+Tcl_Obj *
+PgPackColumn(Tcl_Interp *interp, PGresult *result, int column, int firstTuple, int endTuple,
+			 Pg_PackType packType, double nullDouble, Tcl_WideInt nullWide, Tcl_Obj **bitmapPtr)
+{
+	static const int sizes[] = {
+		sizeof(double), sizeof(float), sizeof(int32_t), sizeof(int64_t)
+	};
+
+	int            ntuples = endTuple - firstTuple;
+	int            binary = (PQfformat(result, column) == 1);
+	Oid            type = PQftype(result, column);
+	int            size = sizes[packType];
+	int            wantDouble = (packType == PG_PACK_DOUBLE || packType == PG_PACK_FLOAT);
+	int            n;
+	int            tupno;
+	Tcl_Obj       *packedObj;
+	unsigned char *out;
+	unsigned char *bitmap = NULL;
+
+	packedObj = Tcl_NewByteArrayObj(NULL, 0);
+	out = Tcl_SetByteArrayLength(packedObj, ntuples * size);
+
+	if (bitmapPtr != NULL) {
+		*bitmapPtr = Tcl_NewByteArrayObj(NULL, 0);
+		bitmap = Tcl_SetByteArrayLength(*bitmapPtr, (ntuples + 7) / 8);
+		memset(bitmap, 0, (ntuples + 7) / 8);
+	}
+
+	for (n = 0, tupno = firstTuple; n < ntuples; n++, tupno++, out += size)
+	{
+		double       doubleValue = 0.0;
+		Tcl_WideInt  wideValue = 0;
+		int          isDouble;
+
+		if (PQgetisnull(result, tupno, column)) {
+			if (bitmap != NULL)
+				bitmap[n / 8] |= (unsigned char)(1 << (n % 8));
+			doubleValue = nullDouble;
+			wideValue = nullWide;
+			isDouble = wantDouble;
+		} else if (binary) {
+			if (!pgPackBinary(type, (const unsigned char *)PQgetvalue(result, tupno, column),
+							  PQgetlength(result, tupno, column), &isDouble, &doubleValue, &wideValue))
+				goto bad_value;
+		} else {
+			const char *value = PQgetvalue(result, tupno, column);
+			char       *end;
+
+			errno = 0;
+			if (type == PG_TYPE_BOOL && (value[0] == 't' || value[0] == 'f') && value[1] == '\0') {
+				wideValue = (value[0] == 't');
+				end = (char *)value + 1;
+				isDouble = 0;
+			} else if (wantDouble) {
+				doubleValue = strtod(value, &end);
+				isDouble = 1;
+			} else {
+				wideValue = strtoll(value, &end, 10);
+				isDouble = 0;
+			}
+			if (end == value || *end != '\0' || (!wantDouble && errno == ERANGE))
+				goto bad_value;
+		}
+
+		/* integers read from binary fields may still need converting */
+		if (wantDouble && !isDouble) {
+			doubleValue = (double)wideValue;
+		} else if (!wantDouble && isDouble) {
+			if (!(doubleValue >= (double)INT64_MIN && doubleValue < (double)INT64_MAX)
+			    || doubleValue != (double)(Tcl_WideInt)doubleValue)
+				goto bad_value;
+			wideValue = (Tcl_WideInt)doubleValue;
+		}
+
+		switch (packType)
+		{
+			case PG_PACK_DOUBLE:
+				memcpy(out, &doubleValue, sizeof doubleValue);
+				break;
+
+			case PG_PACK_FLOAT: {
+				float floatValue = (float)doubleValue;
+				memcpy(out, &floatValue, sizeof floatValue);
+				break;
+			}
+
+			case PG_PACK_INT32: {
+				int32_t int32Value;
+				if (wideValue < INT32_MIN || wideValue > INT32_MAX)
+					goto bad_value;
+				int32Value = (int32_t)wideValue;
+				memcpy(out, &int32Value, sizeof int32Value);
+				break;
+			}
+
+			case PG_PACK_INT64: {
+				int64_t int64Value = (int64_t)wideValue;
+				memcpy(out, &int64Value, sizeof int64Value);
+				break;
+			}
+		}
+		continue;
+
+	    bad_value:
+		pgPackBadValue(interp, result, tupno, column, packType);
+		Tcl_DecrRefCount(packedObj);
+		if (bitmapPtr != NULL) {
+			Tcl_DecrRefCount(*bitmapPtr);
+			*bitmapPtr = NULL;
+		}
+		return NULL;
+	}
+
+	return packedObj;
+}
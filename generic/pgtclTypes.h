@@ -0,0 +1,92 @@
+/*-------------------------------------------------------------------------
+ *
+ * pgtclTypes.h
+ *	  conversion of PostgreSQL field values to native Tcl objects
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#ifndef PGTCLTYPES_H
+#define PGTCLTYPES_H
+
+#include <tcl.h>
+#include "libpq-fe.h"
+
+/* Type OIDs from the server's pg_type.h that we know how to convert */
+#define PG_TYPE_BOOL		16
+#define PG_TYPE_BYTEA		17
+#define PG_TYPE_CHAR		18
+#define PG_TYPE_NAME		19
+#define PG_TYPE_INT8		20
+#define PG_TYPE_INT2		21
+#define PG_TYPE_INT4		23
+#define PG_TYPE_TEXT		25
+#define PG_TYPE_OID			26
+#define PG_TYPE_JSON		114
+#define PG_TYPE_XML			142
+#define PG_TYPE_FLOAT4		700
+#define PG_TYPE_FLOAT8		701
+#define PG_TYPE_UNKNOWN		705
+#define PG_TYPE_BPCHAR		1042
+#define PG_TYPE_VARCHAR		1043
+#define PG_TYPE_DATE		1082
+#define PG_TYPE_TIMESTAMP	1114
+#define PG_TYPE_TIMESTAMPTZ	1184
+#define PG_TYPE_NUMERIC		1700
+#define PG_TYPE_UUID		2950
+#define PG_TYPE_JSONB		3802
+
+/* ... and their array types */
+#define PG_TYPE_BOOL_ARRAY			1000
+#define PG_TYPE_BYTEA_ARRAY			1001
+#define PG_TYPE_INT2_ARRAY			1005
+#define PG_TYPE_INT4_ARRAY			1007
+#define PG_TYPE_TEXT_ARRAY			1009
+#define PG_TYPE_BPCHAR_ARRAY		1014
+#define PG_TYPE_VARCHAR_ARRAY		1015
+#define PG_TYPE_INT8_ARRAY			1016
+#define PG_TYPE_FLOAT4_ARRAY		1021
+#define PG_TYPE_FLOAT8_ARRAY		1022
+#define PG_TYPE_OID_ARRAY			1028
+#define PG_TYPE_TIMESTAMP_ARRAY		1115
+#define PG_TYPE_DATE_ARRAY			1182
+#define PG_TYPE_TIMESTAMPTZ_ARRAY	1185
+#define PG_TYPE_NUMERIC_ARRAY		1231
+#define PG_TYPE_UUID_ARRAY			2951
+
+/* How a column's text values are turned into Tcl objects with -typed */
+typedef enum {
+	PG_TYPED_STRING,		/* left as a string */
+	PG_TYPED_INTEGER,		/* wide integer */
+	PG_TYPED_DOUBLE,		/* double, keeping the server's text */
+	PG_TYPED_BOOLEAN,		/* boolean, keeping the server's text */
+	PG_TYPED_NUMERIC		/* integer, bignum or double, keeping the text */
+} Pg_TypedKind;
+
+extern Pg_TypedKind PgTypedKind(Oid type);
+extern Tcl_Obj *PgNewTypedObj(Tcl_Interp *interp, Pg_TypedKind kind, const char *value, int length);
+extern Tcl_Obj *PgNewBinaryObj(Tcl_Interp *interp, Oid type, const char *value, int length, const char *timeZone);
+
+/* What PgBinaryParam may infer from a parameter's internal representation */
+#define PG_INFER_NONE		0	/* nothing; only explicit types go binary */
+#define PG_INFER_BYTEA		1	/* byte arrays are sent as bytea */
+#define PG_INFER_ALL		2	/* also integers as int8, doubles as float8 */
+#define PG_INFER_RAW		3	/* byte arrays as their bytes, type left to the server */
+
+#define PG_PARAM_SCRATCH	8	/* scratch bytes PgBinaryParam needs */
+
+extern int PgBinaryParam(Tcl_Interp *interp, Tcl_Obj *obj, int infer, Oid *typePtr,
+						 const char **valuePtr, int *lengthPtr, int *formatPtr, char *scratch);
+
+/* Native value types pg_result -packed can produce */
+typedef enum {
+	PG_PACK_DOUBLE,
+	PG_PACK_FLOAT,
+	PG_PACK_INT32,
+	PG_PACK_INT64
+} Pg_PackType;
+
+extern Tcl_Obj *PgPackColumn(Tcl_Interp *interp, PGresult *result, int column, int firstTuple, int endTuple,
+							 Pg_PackType packType, double nullDouble, Tcl_WideInt nullWide, Tcl_Obj **bitmapPtr);
+
+#endif
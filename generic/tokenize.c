@@ -455,23 +455,80 @@ int Pg_sqlite3GetToken(const char *z, enum sqltoken *tokenType){
   return i;
 }
 
-extern int array_to_utf8(Tcl_Interp *interp, const char **paramValues, int *paramLengths, int nParams, const char **bufferPtr);
+extern int array_to_utf8(Tcl_Interp *interp, const char **paramValues, int *paramLengths, int nParams, const char **bufferPtr, Pg_Arena *arena);
 
-int handle_substitutions(Tcl_Interp *interp, const char *sql, char **newSqlPtr, const char ***replacementArrayPtr, int *replacementArrayLengthPtr, const char **bufferPtr)
+/*
+** The parse of a query's :variable references is kept in the query
+** object's internal representation, so running the same literal query
+** again skips the tokenizer and only has to look up the variables.
+*/
+typedef struct Pg_SubstParse {
+	int       refCount;		/* objects and callers holding this parse */
+	char     *newSql;		/* the query with $n in place of each reference */
+	int       newSqlLength;
+	int       nVars;		/* number of references */
+	Tcl_Obj **varNames;		/* name of the variable for each reference */
+} Pg_SubstParse;
+
+static void FreeSubstInternalRep(Tcl_Obj *objPtr);
+static void DupSubstInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *dupPtr);
+
+static const Tcl_ObjType substType = {
+	"pgtclSubstitution",
+	FreeSubstInternalRep,
+	DupSubstInternalRep,
+	NULL,
+	NULL
+};
+
+static void release_parse(Pg_SubstParse *parse)
+{
+	int i;
+
+	if (--parse->refCount > 0)
+		return;
+
+	for (i = 0; i < parse->nVars; i++)
+		Tcl_DecrRefCount(parse->varNames[i]);
+	if (parse->varNames) ckfree((char *)parse->varNames);
+	ckfree(parse->newSql);
+	ckfree((char *)parse);
+}
+
+static void FreeSubstInternalRep(Tcl_Obj *objPtr)
 {
+	release_parse((Pg_SubstParse *)objPtr->internalRep.twoPtrValue.ptr1);
+	objPtr->typePtr = NULL;
+}
+
+static void DupSubstInternalRep(Tcl_Obj *srcPtr, Tcl_Obj *dupPtr)
+{
+	Pg_SubstParse *parse = (Pg_SubstParse *)srcPtr->internalRep.twoPtrValue.ptr1;
+
+	parse->refCount++;
+	dupPtr->internalRep.twoPtrValue.ptr1 = parse;
+	dupPtr->typePtr = &substType;
+}
+
+/*
+** Tokenize sql, replacing each :var, :{var} or $var reference with $1, $2
+** and so on, and noting the variable names.
+*/
+static Pg_SubstParse *parse_substitutions(Tcl_Interp *interp, const char *sql)
+{
+	size_t sqlLength = strlen(sql);
 	// Worst possible case, :a mapping to $99999 at the end of a really long string
-	char *newSql = ckalloc(strlen(sql)*3+1);
+	char *newSql = ckalloc(sqlLength*3+1);
 	// Worst possible case? the sql is nothing but ":varname" and they're all one character names. This
 	// will still be big enough.
-	const char **replacementArray = (const char **)ckalloc((strlen(sql)/2) * (sizeof *replacementArray));
-	int *lengthArray = (int *)ckalloc((strlen(sql)/2) * sizeof (int));
+	Tcl_Obj **varNames = (Tcl_Obj **)ckalloc((sqlLength/2 + 1) * (sizeof *varNames));
+	Pg_SubstParse *parse;
 
 	const char *p;
 	char *q;
 	int len;
 	enum sqltoken tk;
 	int nextVarIndex = 0;
-	int result = TCL_OK;
 
 	p = sql;
 	q = newSql;
@@ -480,14 +537,13 @@ int handle_substitutions(Tcl_Interp *interp, const char *sql, char **newSqlPtr,
 		switch (tk) {
 			case TK_SQLVAR: {
 				Tcl_SetResult(interp, "Can't combine Tcl and Postgres substitutions", TCL_STATIC);
-				result = TCL_ERROR;
-				goto cleanup_and_exit;
+				while(nextVarIndex > 0)
+					Tcl_DecrRefCount(varNames[--nextVarIndex]);
+				ckfree((char *)varNames);
+				ckfree(newSql);
+				return NULL;
 			}
 			case TK_TCLVAR: {
-				char *nameBuf = ckalloc(len);
-				int stringLength;
-				Tcl_Obj *varObj = NULL;
-				int i;
 				int skip = 1;
 				int trunc = 0;
 
@@ -497,18 +553,8 @@ int handle_substitutions(Tcl_Interp *interp, const char *sql, char **newSqlPtr,
 					trunc = 1;
 				}
 
-				for(i = skip; i < len; i++)
-					nameBuf[i-skip] = p[i];
-				nameBuf[i-skip-trunc] = 0;
-				varObj = Tcl_GetVar2Ex(interp, nameBuf, NULL, 0);
-				if(varObj) {
-					replacementArray[nextVarIndex] = Tcl_GetStringFromObj(varObj, &stringLength);
-					lengthArray[nextVarIndex] = stringLength;
-				} else {
-					replacementArray[nextVarIndex] = NULL;
-					lengthArray[nextVarIndex] = 0;
-				}
-				ckfree(nameBuf);
+				varNames[nextVarIndex] = Tcl_NewStringObj(p + skip, len - skip - trunc);
+				Tcl_IncrRefCount(varNames[nextVarIndex]);
 				p += len;
 
 				sprintf(q, "$%d", nextVarIndex+1); //1 indexed
@@ -529,20 +575,83 @@ int handle_substitutions(Tcl_Interp *interp, const char *sql, char **newSqlPtr,
 	}
 	*q = 0;
 
-	if(result == TCL_OK)
-		result = array_to_utf8(interp, replacementArray, lengthArray, nextVarIndex, bufferPtr);
+	parse = (Pg_SubstParse *)ckalloc(sizeof *parse);
+	parse->refCount = 0;
+	parse->newSqlLength = q - newSql;
+	parse->newSql = ckrealloc(newSql, parse->newSqlLength + 1);
+	parse->nVars = nextVarIndex;
+	if (nextVarIndex) {
+		parse->varNames = (Tcl_Obj **)ckrealloc((char *)varNames, nextVarIndex * (sizeof *varNames));
+	} else {
+		parse->varNames = NULL;
+		ckfree((char *)varNames);
+	}
+	return parse;
+}
+
+/*
+** Rewrite the :variable references in the query sqlObj as $n parameters,
+** returning the new query and the variables' values.  The new query and
+** the value array are the caller's to ckfree, as is the buffer, if any,
+** that array_to_utf8 converted values into.  If arena is not NULL they
+** come from it instead.
+*/
+int handle_substitutions(Tcl_Interp *interp, Tcl_Obj *sqlObj, char **newSqlPtr, const char ***replacementArrayPtr, int *replacementArrayLengthPtr, const char **bufferPtr, Pg_Arena *arena)
+{
+	Pg_SubstParse *parse;
+	char *newSql;
+	const char **replacementArray;
+	int *lengthArray;
+	int i;
+	int result;
+
+	if (sqlObj->typePtr == &substType) {
+		parse = (Pg_SubstParse *)sqlObj->internalRep.twoPtrValue.ptr1;
+	} else {
+		parse = parse_substitutions(interp, Tcl_GetString(sqlObj));
+		if (parse == NULL)
+			return TCL_ERROR;
+
+		if (sqlObj->typePtr && sqlObj->typePtr->freeIntRepProc)
+			sqlObj->typePtr->freeIntRepProc(sqlObj);
+		parse->refCount = 1;
+		sqlObj->internalRep.twoPtrValue.ptr1 = parse;
+		sqlObj->internalRep.twoPtrValue.ptr2 = NULL;
+		sqlObj->typePtr = &substType;
+	}
+
+	// Hold on to the parse while reading variables, whose traces could shimmer sqlObj
+	parse->refCount++;
+
+	newSql = PgScratchAlloc(arena, parse->newSqlLength + 1);
+	memcpy(newSql, parse->newSql, parse->newSqlLength + 1);
+	replacementArray = (const char **)PgScratchAlloc(arena, (parse->nVars + 1) * (sizeof *replacementArray));
+	lengthArray = (int *)PgScratchAlloc(arena, (parse->nVars + 1) * sizeof (int));
+
+	for(i = 0; i < parse->nVars; i++) {
+		Tcl_Obj *varObj = Tcl_ObjGetVar2(interp, parse->varNames[i], NULL, 0);
+
+		if(varObj) {
+			replacementArray[i] = Tcl_GetStringFromObj(varObj, &lengthArray[i]);
+		} else {
+			replacementArray[i] = NULL;
+			lengthArray[i] = 0;
+		}
+	}
+
+	result = array_to_utf8(interp, replacementArray, lengthArray, parse->nVars, bufferPtr, arena);
 
-  cleanup_and_exit:
-	if(lengthArray) ckfree(lengthArray);
+	PgScratchFree(arena, lengthArray);
 
 	if(result == TCL_OK) {
 		*newSqlPtr = newSql;
 		*replacementArrayPtr = replacementArray;
-		*replacementArrayLengthPtr = nextVarIndex;
+		*replacementArrayLengthPtr = parse->nVars;
 	} else {
-		ckfree(newSql);
-		ckfree((char *)replacementArray);
+		PgScratchFree(arena, newSql);
+		PgScratchFree(arena, replacementArray);
 	}
+
+	release_parse(parse);
 	return result;
 }
-
@@ -26,12 +26,16 @@ proc doit {} {
 	exit 1
     }
 
+    set lines {}
+    set rows {}
     while {[gets $fp line] >= 0} {
-	set result [pg_exec_prepared $conn pgtest_insert_people [lindex $line 0] [lindex $line 1] [lindex $line 2] [lindex $line 3] [lindex $line 4] [lindex $line 5]]
-        if {[pg_result $result -status] != "PGRES_COMMAND_OK"} {
-	    puts "[pg_result $result -error] inserting '$line'"
-	}
-	pg_result $result -clear
+	lappend lines $line
+	lappend rows [lrange $line 0 5]
+    }
+
+    set status [pg_exec_prepared_many -onerror continue $conn pgtest_insert_people $rows]
+    foreach {index error} [dict get $status errors] {
+	puts "$error inserting '[lindex $lines $index]'"
     }
 }
 